@@ -20,6 +20,113 @@ Other standard files:
 a.h, b.cpp
     These files are used to [...explanation...].
 
+rawContainer.h, rawConvert.cpp
+    Self-describing chunked image container (.craw): header with the shape, an index,
+    and independently delta+RLE compressed row bands. rawConvert packs/unpacks/inspects:
+    g++ -std=c++17 -O2 rawConvert.cpp -o rawConvert
+    ./rawConvert pack ./images/Flower.raw ./outputs/Flower.craw 768 512 3
+    viewRaw.py reads .craw files directly.
+
+fftConvolution.h
+    Overlap-save FFT convolution (real-to-complex, cached kernel spectrum) used by the
+    Gaussian/uniform filters in p2a, p2d and p3 for kernels of 7 x 7 and larger.
+
+fixedPointConvolution.h
+    Q-format integer kernels with 16/32-bit SIMD accumulators (NEON / SSE2), used by the
+    FIXED_POINT_MODE paths in p2a, p2d and p3; within one gray level of the double loops.
+
+channelLayout.h
+    Interleaved <-> planar conversion (NEON structured loads / SSSE3 shuffles) and one
+    thread per plane, for PLANAR_MODE in p2d and p3.
+
+recursiveGaussian.h
+    Young - van Vliet recursive (IIR) Gaussian at a fixed cost per pixel for any sigma,
+    edges replicated; the RECURSIVE_GAUSSIAN_SIGMA paths in p2a, p2d and p3 use it.
+
+gaussianFilter.h
+    Gaussian filter plan for interleaved images and planes (p2d, p3): picks the direct,
+    fixed-point, FFT or recursive path once per shape and owns its work buffers.
+
+imageDiff.h
+    One-pass SIMD/multithreaded image diff: per-channel error histograms, max/mean error,
+    PSNR, threshold count, optional difference map and a capped listing (p1a compareImages).
+
+autoTuner.h
+    Times candidate implementations once per host and shape (Gaussian variants and FFT tile
+    sizes in p2a/p2d/p3, NLM thread count in p2c) and keeps the winners in ./autotune.txt,
+    keyed by CPU model and thread count; delete the file to tune again. Set AUTO_TUNE = false to disable.
+
+pipelineGraph.h
+    Lazy dataflow graph for filter pipelines (p3): runs only what the outputs need, runs
+    independent branches concurrently, fuses pointwise ops (clamp, linear combine, LUT) into
+    the producing stencil's band loop, and recycles intermediates after their last consumer.
+
+guidedFilter.h
+    O(1) guided filter from running-sum box means (self-guided gray, color-guided BGR).
+    GUIDED_FILTER_MODE in p2b and p3 swaps it in for the bilateral filter (radius
+    filterSize / 2, eps = range sigma squared).
+
+imagePyramid.h
+    2 x 2 box-average image pyramid and joint bilateral upsampling. PREVIEW_LEVELS in p2c
+    (NLM) and p3 (bilateral passes) runs the operator on a coarse level and upsamples it
+    guided by the full-resolution input; keep it at 0 for the final render.
+
+tiledImage.h
+    Out-of-core image storage: 64-bit addressed square tiles in a file, an LRU tile cache
+    with write-back, and a prefetch thread for the next block and its halo. Includes
+    block-wise stencils and a two-pass CLAHE with global tile histograms;
+    OUT_OF_CORE_MODE in p1c (CLAHE) and p2a (uniform / Gaussian) runs on it.
+
+cpuDispatch.h
+    Runtime CPU dispatch: histogram, LUT, direct convolution, bilateral, 3 x 3 / 5 x 5
+    median (sorting networks on shared sorted columns), demosaic, BGR -> YUV, MSE and exp
+    kernels compiled for baseline / SSE4 / AVX2 / AVX-512 and bound once from the host's
+    CPU features (p1d, p2_PSNR, p2c, p2d, p3). Identical results on every level;
+    CPU_DISPATCH=baseline|sse4|avx2|avx512 forces a lower level for benchmarking.
+
+imageKernels.h, imageKernels.cpp, imageKernels.py
+    The kernels as a shared library with a plain C ABI on caller-owned buffers (pointer,
+    width, height, stride, channels): median, Gaussian, bilateral, guided filter,
+    histogram, LUT, BGR -> YUV and MSE; outputs may alias the input, and scratch buffers
+    and weights are cached per calling thread. imageKernels.py wraps it for numpy via
+    ctypes (ik.median(image, 3, out=image) filters in place):
+    g++ -std=c++17 -O2 -shared -fPIC imageKernels.cpp -o libimagekernels.so
+
+memoryProfiler.h
+    Allocation and peak-memory profile per named stage: allocations, bytes allocated, net
+    and peak heap (every global operator new / delete form hooked, frees charged back to
+    the allocating stage) and VmRSS / VmHWM from /proc/self/status. Every pipelineGraph.h
+    node is a stage; MEMORY_PROFILE in p2d and p3 prints the table to stderr at the end
+    (build with -DMEMORY_PROFILE_BUILD for the heap columns; default builds keep the
+    system allocator).
+
+adaptiveDenoise.h
+    Content-adaptive denoising: a running-sum box mean everywhere, tiles scored by the
+    variance of that smoothed image, and the expensive filter run only on textured tiles
+    (bit-identical to it there) and on short ramp bands into the flat tiles next to them.
+    ADAPTIVE_MODE in p2b (bilateral) and p2c (exact NLM) uses it.
+
+fastExp.h
+    Branch-free float exponentials at three accuracy levels: EXP_PRECISION_1E3 (relative
+    error < 8e-5), EXP_PRECISION_1E5 (< 3e-6) and EXP_PRECISION_FULL (std::exp), with the
+    vectorized array version in cpuDispatch.h (expRow). EXP_PRECISION in p2c selects the
+    level of the NLM patch-similarity weights.
+
+filterService.h, filterServer.cpp, filterClient.py
+    Local filter daemon: the imageKernels.cpp kernels served over a Unix domain socket to
+    clients that keep their images in a shared memory segment (requests carry offsets, not
+    pixels). One poll loop queues the requests of all connections to a fixed pool of warm
+    worker threads, which keep their kernel caches across requests; filterService.h has the protocol and a C++ client, filterClient.py a numpy
+    one. ./filterServer bench measures the round-trip overhead on 768 x 512 images:
+    g++ -std=c++17 -O2 -pthread filterServer.cpp imageKernels.cpp -o filterServer
+
+exactBucketFill.h
+    Exact bucket filling: every pixel ranked by value, ties broken by raster position or
+    by the 3 x 3 local mean, and rank r of N mapped to floor(r * 256 / N), so each of the
+    256 output values holds N / 256 pixels. The ranking is parallel stable counting sort
+    passes (O(N)): by value, or by 3 x 3 sum and then by value. EXACT_BUCKET_MODE in p1b
+    and p1c (Y channel) uses it.
+
 /////////////////////////////////////////////////////////////////////////////
 Other notes:
 
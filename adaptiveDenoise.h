@@ -0,0 +1,284 @@
+// Content-adaptive denoising: the expensive filter only where the image has structure
+//
+// In flat regions (sky, walls) an edge-preserving filter such as the bilateral filter or
+// NLM gives about what a plain box mean gives, at many times the cost. The adaptive filter
+//   1. box-smooths the gray image with running sums (O(1) per pixel, radius smoothRadius),
+//   2. scores each tileSize x tileSize tile by the variance of the smoothed image over it.
+//      The box divides the noise variance by its area, so what is left is structure
+//      (texture, edges, gradients); tiles scoring above `threshold` are textured,
+//   3. runs the expensive filter, through a callback that filters one rectangle of the
+//      image, on the textured tiles (a horizontal run of them per call) and on a ramp band
+//      of tileSize / 4 pixels along the sides of a flat tile that touch a textured one,
+//   4. keeps the expensive result unchanged on the textured tiles, so they are bit-identical
+//      to the expensive filter alone, and the box mean on the flat tiles except in the ramp
+//      bands, where the weight of the expensive result falls linearly with the distance to
+//      the nearest textured tile. The switch between the filters is therefore a short ramp
+//      inside the flat tile rather than a seam at its border.
+
+#ifndef ADAPTIVE_DENOISE_H
+#define ADAPTIVE_DENOISE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Plan: the tile grid, the smoothed image, the expensive filter's output and the per-tile
+// maps, built once for the image shape and parameters; executing it allocates nothing
+struct AdaptiveDenoisePlan {
+    int width;
+    int height;
+    int tileSize;
+    int tilesX;
+    int tilesY;
+    int smoothRadius;
+    int rampWidth;                      // pixels of a flat tile blended toward a textured neighbor
+    double threshold;                   // variance of the smoothed image (gray levels^2)
+    std::vector<uint32_t> columnSums;   // vertical running sums, one per column
+    std::vector<unsigned char> smooth;  // box mean of the input
+    std::vector<unsigned char> detail;  // expensive filter output (valid where it ran)
+    std::vector<double> activity;       // per tile: variance of the smoothed image
+    std::vector<unsigned char> textured;
+    std::vector<unsigned char> neighbors;   // per flat tile: its textured neighbors, one bit each
+    int texturedTiles;
+    size_t filteredPixels;              // pixels the expensive filter ran on
+};
+
+// Helper function: bit of the neighbor (tx + dx, ty + dy) in AdaptiveDenoisePlan::neighbors
+inline int adaptiveNeighborBit(int dx, int dy) {
+    const int index = (dy + 1) * 3 + (dx + 1);
+    return 1 << (index > 4 ? index - 1 : index);
+}
+
+// Function: build an adaptive denoising plan
+inline AdaptiveDenoisePlan createAdaptiveDenoisePlan(int width, int height, int tileSize, double threshold,
+                                                     int smoothRadius) {
+    AdaptiveDenoisePlan plan;
+    plan.width = width;
+    plan.height = height;
+    plan.tileSize = tileSize;
+    plan.tilesX = (width + tileSize - 1) / tileSize;
+    plan.tilesY = (height + tileSize - 1) / tileSize;
+    plan.smoothRadius = smoothRadius;
+    plan.rampWidth = std::max(1, tileSize / 4);
+    plan.threshold = threshold;
+    plan.columnSums.resize(width);
+    plan.smooth.resize(static_cast<size_t>(width) * height);
+    plan.detail.resize(static_cast<size_t>(width) * height);
+    plan.activity.resize(plan.tilesX * plan.tilesY);
+    plan.textured.resize(plan.tilesX * plan.tilesY);
+    plan.neighbors.resize(plan.tilesX * plan.tilesY);
+    plan.texturedTiles = 0;
+    plan.filteredPixels = 0;
+    return plan;
+}
+
+// Helper function: box mean of radius plan.smoothRadius into plan.smooth (windows clipped at
+// the borders and normalized by their actual size, rounded to nearest)
+inline void boxSmoothImage(AdaptiveDenoisePlan& plan, const std::vector<unsigned char>& image) {
+    const int width = plan.width;
+    const int height = plan.height;
+    const int radius = plan.smoothRadius;
+    std::fill(plan.columnSums.begin(), plan.columnSums.end(), 0u);
+    for (int y = 0; y < std::min(radius, height); ++y) {
+        for (int x = 0; x < width; ++x) {
+            plan.columnSums[x] += image[y * width + x];
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        // slide the column sums to rows [y - radius, y + radius]
+        if (y + radius < height) {
+            for (int x = 0; x < width; ++x) {
+                plan.columnSums[x] += image[(y + radius) * width + x];
+            }
+        }
+        if (y - radius - 1 >= 0) {
+            for (int x = 0; x < width; ++x) {
+                plan.columnSums[x] -= image[(y - radius - 1) * width + x];
+            }
+        }
+        const uint32_t rows = std::min(y + radius, height - 1) - std::max(y - radius, 0) + 1;
+
+        uint32_t sum = 0;
+        for (int x = 0; x < std::min(radius, width); ++x) {
+            sum += plan.columnSums[x];
+        }
+        unsigned char* out = &plan.smooth[y * width];
+        for (int x = 0; x < width; ++x) {
+            if (x + radius < width) {
+                sum += plan.columnSums[x + radius];
+            }
+            if (x - radius - 1 >= 0) {
+                sum -= plan.columnSums[x - radius - 1];
+            }
+            const uint32_t count = rows * (std::min(x + radius, width - 1) - std::max(x - radius, 0) + 1);
+            out[x] = static_cast<unsigned char>((sum + count / 2) / count);
+        }
+    }
+}
+
+// Helper function: score the tiles on plan.smooth, mark the textured ones and record the
+// textured neighbors of the flat ones
+inline void classifyTiles(AdaptiveDenoisePlan& plan) {
+    const int tileSize = plan.tileSize;
+    plan.texturedTiles = 0;
+    for (int ty = 0; ty < plan.tilesY; ++ty) {
+        for (int tx = 0; tx < plan.tilesX; ++tx) {
+            const int rowEnd = std::min((ty + 1) * tileSize, plan.height);
+            const int colEnd = std::min((tx + 1) * tileSize, plan.width);
+            int64_t sum = 0;
+            int64_t sumSquares = 0;
+            for (int y = ty * tileSize; y < rowEnd; ++y) {
+                const unsigned char* row = &plan.smooth[y * plan.width];
+                for (int x = tx * tileSize; x < colEnd; ++x) {
+                    sum += row[x];
+                    sumSquares += row[x] * row[x];
+                }
+            }
+            const double count = static_cast<double>(rowEnd - ty * tileSize) * (colEnd - tx * tileSize);
+            const double mean = sum / count;
+            const int tile = ty * plan.tilesX + tx;
+            plan.activity[tile] = sumSquares / count - mean * mean;
+            plan.textured[tile] = plan.activity[tile] > plan.threshold;
+            plan.texturedTiles += plan.textured[tile];
+        }
+    }
+
+    for (int ty = 0; ty < plan.tilesY; ++ty) {
+        for (int tx = 0; tx < plan.tilesX; ++tx) {
+            int bits = 0;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    const int nx = tx + dx;
+                    const int ny = ty + dy;
+                    if ((dx != 0 || dy != 0) && nx >= 0 && nx < plan.tilesX && ny >= 0 && ny < plan.tilesY &&
+                        plan.textured[ny * plan.tilesX + nx]) {
+                        bits |= adaptiveNeighborBit(dx, dy);
+                    }
+                }
+            }
+            const int tile = ty * plan.tilesX + tx;
+            plan.neighbors[tile] = plan.textured[tile] ? 0 : static_cast<unsigned char>(bits);
+        }
+    }
+}
+
+// Helper function: weight (0..256) of the expensive result at (x, y) in a flat tile with
+// textured neighbors. d is the distance to the nearest of them (1 next to a shared border;
+// Chebyshev distance for a diagonal one); the weight is 256 * (1 - d / (rampWidth + 1)),
+// 0 past the ramp
+inline int adaptiveRampWeight(const AdaptiveDenoisePlan& plan, int tile, int x, int y) {
+    const int tx = tile % plan.tilesX;
+    const int ty = tile / plan.tilesX;
+    const int left = x - tx * plan.tileSize + 1;
+    const int right = std::min((tx + 1) * plan.tileSize, plan.width) - x;
+    const int up = y - ty * plan.tileSize + 1;
+    const int down = std::min((ty + 1) * plan.tileSize, plan.height) - y;
+    int distance = plan.rampWidth + 1;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            if ((dx != 0 || dy != 0) && (plan.neighbors[tile] & adaptiveNeighborBit(dx, dy))) {
+                const int distanceX = dx < 0 ? left : dx > 0 ? right : 0;
+                const int distanceY = dy < 0 ? up : dy > 0 ? down : 0;
+                distance = std::min(distance, std::max(distanceX, distanceY));
+            }
+        }
+    }
+    return 256 * (plan.rampWidth + 1 - distance) / (plan.rampWidth + 1);
+}
+
+// Function: run an adaptive denoising plan on a gray image. filterRegion(rowBegin, rowEnd,
+// colBegin, colEnd, detail) must write the expensive filter of the input over that rectangle
+// into detail (width * height, row-major); it is called once per horizontal run of textured
+// tiles and once per ramp band. output must already hold width * height pixels.
+template <typename RegionFilter>
+void executeAdaptiveDenoisePlan(AdaptiveDenoisePlan& plan,
+                                const std::vector<unsigned char>& image,
+                                std::vector<unsigned char>& output,
+                                RegionFilter filterRegion) {
+    const int width = plan.width;
+    const int tileSize = plan.tileSize;
+    boxSmoothImage(plan, image);
+    classifyTiles(plan);
+
+    plan.filteredPixels = 0;
+    auto filter = [&](int rowBegin, int rowEnd, int colBegin, int colEnd) {
+        filterRegion(rowBegin, rowEnd, colBegin, colEnd, plan.detail);
+        plan.filteredPixels += static_cast<size_t>(rowEnd - rowBegin) * (colEnd - colBegin);
+    };
+    for (int ty = 0; ty < plan.tilesY; ++ty) {
+        const int rowBegin = ty * tileSize;
+        const int rowEnd = std::min(rowBegin + tileSize, plan.height);
+        for (int tx = 0; tx < plan.tilesX;) {
+            if (!plan.textured[ty * plan.tilesX + tx]) {
+                ++tx;
+                continue;
+            }
+            int runEnd = tx;
+            while (runEnd < plan.tilesX && plan.textured[ty * plan.tilesX + runEnd]) {
+                ++runEnd;
+            }
+            filter(rowBegin, rowEnd, tx * tileSize, std::min(runEnd * tileSize, width));
+            tx = runEnd;
+        }
+    }
+
+    // ramp bands of the flat tiles: full-width bands at the top and bottom when a tile above
+    // or below is textured (diagonals included, which covers the corners), then the side
+    // bands between them
+    const int above = adaptiveNeighborBit(-1, -1) | adaptiveNeighborBit(0, -1) | adaptiveNeighborBit(1, -1);
+    const int below = adaptiveNeighborBit(-1, 1) | adaptiveNeighborBit(0, 1) | adaptiveNeighborBit(1, 1);
+    for (int ty = 0; ty < plan.tilesY; ++ty) {
+        for (int tx = 0; tx < plan.tilesX; ++tx) {
+            const int bits = plan.neighbors[ty * plan.tilesX + tx];
+            if (bits == 0) {
+                continue;
+            }
+            const int rowBegin = ty * tileSize;
+            const int rowEnd = std::min(rowBegin + tileSize, plan.height);
+            const int colBegin = tx * tileSize;
+            const int colEnd = std::min(colBegin + tileSize, width);
+            const int bandBegin = (bits & above) ? std::min(rowBegin + plan.rampWidth, rowEnd) : rowBegin;
+            const int bandEnd = (bits & below) ? std::max(rowEnd - plan.rampWidth, bandBegin) : rowEnd;
+            if (bits & above) {
+                filter(rowBegin, bandBegin, colBegin, colEnd);
+            }
+            if (bits & below) {
+                filter(bandEnd, rowEnd, colBegin, colEnd);
+            }
+            if ((bits & adaptiveNeighborBit(-1, 0)) && bandBegin < bandEnd) {
+                filter(bandBegin, bandEnd, colBegin, std::min(colBegin + plan.rampWidth, colEnd));
+            }
+            if ((bits & adaptiveNeighborBit(1, 0)) && bandBegin < bandEnd) {
+                filter(bandBegin, bandEnd, std::max(colEnd - plan.rampWidth, colBegin), colEnd);
+            }
+        }
+    }
+
+    // the expensive result on textured tiles, the box mean on flat ones, blended in the ramp
+    // bands (8-bit weights)
+    for (int y = 0; y < plan.height; ++y) {
+        const int tileRow = (y / tileSize) * plan.tilesX;
+        const unsigned char* smooth = &plan.smooth[static_cast<size_t>(y) * width];
+        const unsigned char* detail = &plan.detail[static_cast<size_t>(y) * width];
+        unsigned char* out = &output[static_cast<size_t>(y) * width];
+        for (int tx = 0; tx < plan.tilesX; ++tx) {
+            const int tile = tileRow + tx;
+            const int colBegin = tx * tileSize;
+            const int colEnd = std::min(colBegin + tileSize, width);
+            if (plan.textured[tile] || plan.neighbors[tile] == 0) {
+                const unsigned char* source = plan.textured[tile] ? detail : smooth;
+                std::copy(source + colBegin, source + colEnd, out + colBegin);
+                continue;
+            }
+            for (int x = colBegin; x < colEnd; ++x) {
+                const int weight = adaptiveRampWeight(plan, tile, x, y);
+                out[x] = static_cast<unsigned char>((weight * detail[x] + (256 - weight) * smooth[x] + 128) >> 8);
+            }
+        }
+    }
+}
+
+#endif // ADAPTIVE_DENOISE_H
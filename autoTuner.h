@@ -0,0 +1,176 @@
+// Startup auto-tuner
+//
+// The first time an operator is planned for a shape on a host, each candidate
+// implementation is timed (fastest of AUTO_TUNE_REPEATS runs on the caller's benchmark) and
+// the winner is appended to the tuning file; later runs read it back and skip the
+// benchmark. Entries are keyed by CPU model, operator and shape, so one file can serve
+// several machines. The CPU key carries the hardware thread count too: the same model with
+// SMT off or in a smaller VM is another host, since thread-count winners do not carry over.
+// Delete the file (or its lines) to tune again.
+//
+// AUTO_TUNE_FILE holds one entry per line, tab-separated:
+//   cpu model    operator    shape    winner    seconds
+
+#ifndef AUTO_TUNER_H
+#define AUTO_TUNER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+
+const char* const AUTO_TUNE_FILE = "./autotune.txt";
+const int AUTO_TUNE_REPEATS = 3;
+
+// Helper function: CPU key of this host, the model name and the hardware thread count
+// (e.g. "Intel(R) Xeon(R) ... (8 threads)")
+inline std::string cpuModelName() {
+    std::string model;
+#if defined(__APPLE__)
+    char buffer[256];
+    size_t size = sizeof(buffer);
+    if (sysctlbyname("machdep.cpu.brand_string", buffer, &size, nullptr, 0) == 0) {
+        model = buffer;
+    }
+#else
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0 || line.compare(0, 9, "Processor") == 0) {
+            model = line.substr(line.find(':') + 2);
+            break;
+        }
+    }
+#endif
+    if (model.empty()) {
+        model = "unknown";
+    }
+    return model + " (" + std::to_string(std::thread::hardware_concurrency()) + " threads)";
+}
+
+// Helper function: shape key, e.g. "768x512x3"
+inline std::string shapeKey(int width, int height, int channels) {
+    return std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(channels);
+}
+
+// Helper struct: the tuning file, loaded once per process
+struct TuningTable {
+    std::recursive_mutex mutex;             // held for the whole lookup-or-benchmark
+    bool loaded = false;
+    std::string cpu;
+    std::map<std::string, std::string> winners; // "operator\tshape" -> winner (this cpu only)
+};
+
+inline TuningTable& tuningTable() {
+    static TuningTable table;
+    return table;
+}
+
+// Helper function: read this host's entries from the tuning file (caller holds the mutex)
+inline void loadTuningTable(TuningTable& table) {
+    table.cpu = cpuModelName();
+    std::ifstream file(AUTO_TUNE_FILE);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '\t')) {
+            fields.push_back(field);
+        }
+        if (fields.size() >= 4 && fields[0] == table.cpu) {
+            table.winners[fields[1] + "\t" + fields[2]] = fields[3];
+        }
+    }
+    table.loaded = true;
+}
+
+// Function: the fastest candidate of an operator for a shape. run(candidate) must execute the
+// candidate once on representative data of that shape; it is only called when the tuning file
+// has no entry for this host (or the recorded winner is no longer a candidate).
+inline std::string autoTune(const std::string& op,
+                            const std::string& shape,
+                            const std::vector<std::string>& candidates,
+                            const std::function<void(const std::string&)>& run) {
+    if (candidates.size() == 1) {
+        return candidates[0];
+    }
+
+    TuningTable& table = tuningTable();
+    std::lock_guard<std::recursive_mutex> lock(table.mutex);
+    if (!table.loaded) {
+        loadTuningTable(table);
+    }
+    const std::string key = op + "\t" + shape;
+    auto found = table.winners.find(key);
+    if (found != table.winners.end()) {
+        for (const std::string& candidate : candidates) {
+            if (candidate == found->second) {
+                return candidate;
+            }
+        }
+    }
+
+    std::string best;
+    double bestTime = 0.0;
+    for (const std::string& candidate : candidates) {
+        double fastest = 0.0;
+        for (int repeat = 0; repeat < AUTO_TUNE_REPEATS; ++repeat) {
+            auto start = std::chrono::steady_clock::now();
+            run(candidate);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            fastest = (repeat == 0) ? seconds : std::min(fastest, seconds);
+        }
+        if (best.empty() || fastest < bestTime) {
+            best = candidate;
+            bestTime = fastest;
+        }
+    }
+
+    table.winners[key] = best;
+    std::ofstream file(AUTO_TUNE_FILE, std::ios::app);
+    if (file) {
+        file << table.cpu << "\t" << op << "\t" << shape << "\t" << best << "\t" << bestTime << "\n";
+    } else {
+        std::cerr << "Cannot write the tuning file: " << AUTO_TUNE_FILE << std::endl;
+    }
+    return best;
+}
+
+// Function: autoTune over integer candidates (tile sizes, thread counts)
+inline int autoTuneInt(const std::string& op,
+                       const std::string& shape,
+                       const std::vector<int>& candidates,
+                       const std::function<void(int)>& run) {
+    std::vector<std::string> names;
+    for (int candidate : candidates) {
+        names.push_back(std::to_string(candidate));
+    }
+    std::string best = autoTune(op, shape, names, [&](const std::string& name) { run(std::stoi(name)); });
+    return std::stoi(best);
+}
+
+// Helper function: deterministic noise image used as benchmark input
+inline std::vector<unsigned char> benchmarkImage(size_t size) {
+    std::vector<unsigned char> image(size);
+    uint32_t state = 569;
+    for (unsigned char& pixel : image) {
+        state = state * 1664525u + 1013904223u;
+        pixel = static_cast<unsigned char>(state >> 24);
+    }
+    return image;
+}
+
+#endif // AUTO_TUNER_H
@@ -0,0 +1,153 @@
+// Channel layout conversion for the planar modes (p2d, p3)
+//
+// deinterleaveChannels splits an interleaved 3-channel image into three planes once at
+// load, interleaveChannels merges them back at write time; both move 16 pixels per
+// iteration with the NEON structured loads/stores or SSSE3 byte shuffles, with a scalar
+// tail. runPerChannel runs one single-channel job per plane, each on its own thread.
+
+#ifndef CHANNEL_LAYOUT_H
+#define CHANNEL_LAYOUT_H
+
+#include <array>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+// Helper function: build the byte-shuffle masks used by the SIMD layout conversion
+// deinterleave: mask[c][s] gathers the lanes of channel c that live in source vector s
+// interleave:   mask[o][c] scatters channel c into lanes of output vector o
+struct LayoutMasks {
+    alignas(16) unsigned char deinterleave[3][3][16];
+    alignas(16) unsigned char interleave[3][3][16];
+
+    LayoutMasks() {
+        for (int c = 0; c < 3; ++c) {
+            for (int v = 0; v < 3; ++v) {
+                for (int lane = 0; lane < 16; ++lane) {
+                    int from = 3 * lane + c;
+                    deinterleave[c][v][lane] = (from / 16 == v) ? static_cast<unsigned char>(from % 16) : 0x80;
+                    int to = 16 * v + lane;
+                    interleave[v][c][lane] = (to % 3 == c) ? static_cast<unsigned char>(to / 3) : 0x80;
+                }
+            }
+        }
+    }
+};
+
+// Function: split an interleaved 3-channel image into three planes
+inline void deinterleaveChannels(const std::vector<unsigned char>& image,
+                                 std::array<std::vector<unsigned char>, 3>& planes) {
+    const size_t numPixels = image.size() / 3;
+    for (auto& plane : planes) {
+        plane.resize(numPixels);
+    }
+
+    const unsigned char* src = image.data();
+    unsigned char* dst0 = planes[0].data();
+    unsigned char* dst1 = planes[1].data();
+    unsigned char* dst2 = planes[2].data();
+    size_t i = 0;
+
+#if defined(__ARM_NEON)
+    // 16 pixels per iteration with the structured load
+    for (; i + 16 <= numPixels; i += 16) {
+        uint8x16x3_t bgr = vld3q_u8(src + 3 * i);
+        vst1q_u8(dst0 + i, bgr.val[0]);
+        vst1q_u8(dst1 + i, bgr.val[1]);
+        vst1q_u8(dst2 + i, bgr.val[2]);
+    }
+#elif defined(__SSSE3__)
+    // 16 pixels per iteration: three loads, nine shuffles
+    static const LayoutMasks masks;
+    for (; i + 16 <= numPixels; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i + 32));
+        unsigned char* dst[3] = {dst0, dst1, dst2};
+        for (int channel = 0; channel < 3; ++channel) {
+            const auto& m = masks.deinterleave[channel];
+            __m128i plane = _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(a, _mm_load_si128(reinterpret_cast<const __m128i*>(m[0]))),
+                             _mm_shuffle_epi8(b, _mm_load_si128(reinterpret_cast<const __m128i*>(m[1])))),
+                _mm_shuffle_epi8(c, _mm_load_si128(reinterpret_cast<const __m128i*>(m[2]))));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[channel] + i), plane);
+        }
+    }
+#endif
+
+    // scalar tail (and the whole image on targets without SIMD)
+    for (; i < numPixels; ++i) {
+        dst0[i] = src[3 * i];
+        dst1[i] = src[3 * i + 1];
+        dst2[i] = src[3 * i + 2];
+    }
+}
+
+// Function: merge three planes back into an interleaved 3-channel image
+inline std::vector<unsigned char> interleaveChannels(const std::array<std::vector<unsigned char>, 3>& planes) {
+    const size_t numPixels = planes[0].size();
+    std::vector<unsigned char> image(3 * numPixels);
+
+    const unsigned char* src0 = planes[0].data();
+    const unsigned char* src1 = planes[1].data();
+    const unsigned char* src2 = planes[2].data();
+    unsigned char* dst = image.data();
+    size_t i = 0;
+
+#if defined(__ARM_NEON)
+    for (; i + 16 <= numPixels; i += 16) {
+        uint8x16x3_t bgr;
+        bgr.val[0] = vld1q_u8(src0 + i);
+        bgr.val[1] = vld1q_u8(src1 + i);
+        bgr.val[2] = vld1q_u8(src2 + i);
+        vst3q_u8(dst + 3 * i, bgr);
+    }
+#elif defined(__SSSE3__)
+    static const LayoutMasks masks;
+    for (; i + 16 <= numPixels; i += 16) {
+        __m128i p[3] = {
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + i)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + i)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src2 + i))
+        };
+        for (int v = 0; v < 3; ++v) {
+            const auto& m = masks.interleave[v];
+            __m128i out = _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(p[0], _mm_load_si128(reinterpret_cast<const __m128i*>(m[0]))),
+                             _mm_shuffle_epi8(p[1], _mm_load_si128(reinterpret_cast<const __m128i*>(m[1])))),
+                _mm_shuffle_epi8(p[2], _mm_load_si128(reinterpret_cast<const __m128i*>(m[2]))));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * i + 16 * v), out);
+        }
+    }
+#endif
+
+    for (; i < numPixels; ++i) {
+        dst[3 * i] = src0[i];
+        dst[3 * i + 1] = src1[i];
+        dst[3 * i + 2] = src2[i];
+    }
+
+    return image;
+}
+
+// Helper function: run one single-channel job per plane, each on its own thread
+template <typename Job>
+void runPerChannel(std::array<std::vector<unsigned char>, 3>& planes, Job job) {
+    std::array<std::thread, 3> workers;
+    for (int channel = 0; channel < 3; ++channel) {
+        workers[channel] = std::thread([&planes, &job, channel]() {
+            job(planes[channel], channel);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+#endif // CHANNEL_LAYOUT_H
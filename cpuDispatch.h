@@ -0,0 +1,542 @@
+// Runtime CPU dispatch for the hot per-pixel kernels
+//
+// The programs are built without -march flags, so the same binary has to run on SSE4-only
+// hosts and on AVX2 / AVX-512 hosts. Each kernel below is written once as a plain loop over
+// restrict pointers (always inlined) and compiled again inside wrappers carrying a target
+// attribute per ISA level, with the loop vectorizer enabled for that wrapper only. At first
+// use the CPU is queried and the widest supported set of wrappers is bound into a table of
+// function pointers; every later call goes through the table.
+//
+// Override for benchmarking: CPU_DISPATCH=baseline|sse4|avx2|avx512 in the environment
+// (clamped to what the host supports), or cpuKernelsFor(level) for a specific table.
+//
+// All levels produce identical results: floating point kernels keep the per-pixel
+// accumulation order of the scalar loops and never contract into FMAs.
+
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "fastExp.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_DISPATCH_X86 1
+#endif
+
+// clang vectorizes loops at -O2 already and has no per-function fp-contract option: the
+// kernel bodies below (and the fastExp.h polynomials) turn contraction off by pragma instead
+#if defined(__clang__)
+#define CPU_DISPATCH_VECTORIZE
+#elif defined(__GNUC__)
+#define CPU_DISPATCH_VECTORIZE __attribute__((optimize("tree-loop-vectorize", "vect-cost-model=dynamic", "fp-contract=off")))
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_DISPATCH_INLINE __attribute__((always_inline)) inline
+#define CPU_DISPATCH_RESTRICT __restrict
+#else
+#define CPU_DISPATCH_INLINE inline
+#define CPU_DISPATCH_RESTRICT
+#define CPU_DISPATCH_VECTORIZE
+#endif
+
+enum CpuLevel {
+    CPU_BASELINE,   // whatever the translation unit was compiled for (SSE2 on x86-64, NEON on ARM)
+    CPU_SSE4,
+    CPU_AVX2,
+    CPU_AVX512      // AVX-512 F + BW
+};
+
+// Pixels per block of the floating point row kernels (their accumulators live on the stack)
+const int CPU_DISPATCH_BLOCK = 256;
+
+// Kernel bodies ==========================================================================
+
+#if defined(__clang__)
+#pragma float_control(push)
+#pragma clang fp contract(off)
+#endif
+
+// Sub-function: add the values of a width x height region (rows `stride` bytes apart) to a
+// 256-bin histogram (four sub-histograms break the store-to-load dependency of runs of
+// equal values)
+CPU_DISPATCH_INLINE void histogramBody(const unsigned char* CPU_DISPATCH_RESTRICT data,
+                                       int width,
+                                       int height,
+                                       size_t stride,
+                                       int* CPU_DISPATCH_RESTRICT bins) {
+    uint32_t partial[4][256];
+    std::memset(partial, 0, sizeof(partial));
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* row = data + y * stride;
+        int i = 0;
+        for (; i + 4 <= width; i += 4) {
+            partial[0][row[i]]++;
+            partial[1][row[i + 1]]++;
+            partial[2][row[i + 2]]++;
+            partial[3][row[i + 3]]++;
+        }
+        for (; i < width; ++i) {
+            partial[0][row[i]]++;
+        }
+    }
+    for (int b = 0; b < 256; ++b) {
+        bins[b] += static_cast<int>(partial[0][b] + partial[1][b] + partial[2][b] + partial[3][b]);
+    }
+}
+
+// Sub-function: output[i] = lut[input[i]]
+CPU_DISPATCH_INLINE void applyLutBody(const unsigned char* CPU_DISPATCH_RESTRICT input,
+                                      unsigned char* CPU_DISPATCH_RESTRICT output,
+                                      size_t count,
+                                      const unsigned char* CPU_DISPATCH_RESTRICT lut) {
+    for (size_t i = 0; i < count; ++i) {
+        output[i] = lut[input[i]];
+    }
+}
+
+// Sub-function: direct 2-D convolution of `count` interleaved values. source points at the
+// top-left tap of the first output, kernel rows are rowStride bytes apart and horizontal taps
+// `channels` bytes apart. output = clamp(int(sum)), taps summed row by row, left to right
+CPU_DISPATCH_INLINE void convolveRowBody(const unsigned char* source,
+                                         size_t rowStride,
+                                         int channels,
+                                         int count,
+                                         const double* CPU_DISPATCH_RESTRICT kernel,
+                                         int kernelSize,
+                                         unsigned char* CPU_DISPATCH_RESTRICT output) {
+    double sums[CPU_DISPATCH_BLOCK];
+    for (int begin = 0; begin < count; begin += CPU_DISPATCH_BLOCK) {
+        const int n = std::min(CPU_DISPATCH_BLOCK, count - begin);
+        for (int i = 0; i < n; ++i) {
+            sums[i] = 0.0;
+        }
+        for (int r = 0; r < kernelSize; ++r) {
+            for (int c = 0; c < kernelSize; ++c) {
+                const unsigned char* CPU_DISPATCH_RESTRICT taps = source + r * rowStride + begin + c * channels;
+                const double weight = kernel[r * kernelSize + c];
+                for (int i = 0; i < n; ++i) {
+                    sums[i] += taps[i] * weight;
+                }
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            output[begin + i] = static_cast<unsigned char>(std::min(std::max(static_cast<int>(sums[i]), 0), 255));
+        }
+    }
+}
+
+// Sub-function: bilateral filter of `count` interleaved values (source and rowStride as in
+// convolveRow, center: the values being filtered). rangeWeights is indexed by
+// |center - neighbor|; output = int(sum(w * neighbor) / sum(w)), taps summed row by row,
+// left to right
+CPU_DISPATCH_INLINE void bilateralRowBody(const unsigned char* source,
+                                          size_t rowStride,
+                                          int channels,
+                                          int count,
+                                          const unsigned char* CPU_DISPATCH_RESTRICT center,
+                                          const double* CPU_DISPATCH_RESTRICT spaceWeights,
+                                          int kernelSize,
+                                          const double* CPU_DISPATCH_RESTRICT rangeWeights,
+                                          unsigned char* CPU_DISPATCH_RESTRICT output) {
+    double sums[CPU_DISPATCH_BLOCK];
+    double weightSums[CPU_DISPATCH_BLOCK];
+    for (int begin = 0; begin < count; begin += CPU_DISPATCH_BLOCK) {
+        const int n = std::min(CPU_DISPATCH_BLOCK, count - begin);
+        const unsigned char* CPU_DISPATCH_RESTRICT centers = center + begin;
+        for (int i = 0; i < n; ++i) {
+            sums[i] = 0.0;
+            weightSums[i] = 0.0;
+        }
+        for (int r = 0; r < kernelSize; ++r) {
+            for (int c = 0; c < kernelSize; ++c) {
+                const unsigned char* CPU_DISPATCH_RESTRICT taps = source + r * rowStride + begin + c * channels;
+                const double space = spaceWeights[r * kernelSize + c];
+                for (int i = 0; i < n; ++i) {
+                    int neighbor = taps[i];
+                    double w = space * rangeWeights[std::abs(centers[i] - neighbor)];
+                    sums[i] += neighbor * w;
+                    weightSums[i] += w;
+                }
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            output[begin + i] = static_cast<unsigned char>(static_cast<int>(sums[i] / weightSums[i]));
+        }
+    }
+}
+
+// Largest interleaved channel count of the median kernels (sizes their column buffers)
+const int CPU_DISPATCH_MAX_CHANNELS = 4;
+
+// Helper function: order a pair with a branch-free min/max exchange
+CPU_DISPATCH_INLINE void sortPair(unsigned char& a, unsigned char& b) {
+    unsigned char low = std::min(a, b);
+    b = std::max(a, b);
+    a = low;
+}
+
+// Helper function: median of three
+CPU_DISPATCH_INLINE unsigned char median3(unsigned char a, unsigned char b, unsigned char c) {
+    return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+// Helper function: sort five values (9 exchanges; unused outputs are dropped by the compiler)
+CPU_DISPATCH_INLINE void sort5(unsigned char& v0, unsigned char& v1, unsigned char& v2, unsigned char& v3, unsigned char& v4) {
+    sortPair(v0, v1); sortPair(v3, v4); sortPair(v2, v4);
+    sortPair(v2, v3); sortPair(v0, v3); sortPair(v0, v2);
+    sortPair(v1, v4); sortPair(v1, v3); sortPair(v1, v2);
+}
+
+// Sub-function: 3 x 3 median of `count` interleaved values (source and rowStride as in
+// convolveRow, channels <= CPU_DISPATCH_MAX_CHANNELS). Each vertical triplet is sorted once
+// and shared by the three outputs that see it; the median is then
+// median3(max of the lows, median of the middles, min of the highs)
+CPU_DISPATCH_INLINE void median3x3RowBody(const unsigned char* source,
+                                          size_t rowStride,
+                                          int channels,
+                                          int count,
+                                          unsigned char* CPU_DISPATCH_RESTRICT output) {
+    unsigned char lows[CPU_DISPATCH_BLOCK + 2 * CPU_DISPATCH_MAX_CHANNELS];
+    unsigned char middles[CPU_DISPATCH_BLOCK + 2 * CPU_DISPATCH_MAX_CHANNELS];
+    unsigned char highs[CPU_DISPATCH_BLOCK + 2 * CPU_DISPATCH_MAX_CHANNELS];
+    for (int begin = 0; begin < count; begin += CPU_DISPATCH_BLOCK) {
+        const int n = std::min(CPU_DISPATCH_BLOCK, count - begin);
+        const int columns = n + 2 * channels;
+        const unsigned char* CPU_DISPATCH_RESTRICT up = source + begin;
+        const unsigned char* CPU_DISPATCH_RESTRICT row = up + rowStride;
+        const unsigned char* CPU_DISPATCH_RESTRICT down = row + rowStride;
+        for (int i = 0; i < columns; ++i) {
+            unsigned char a = up[i], b = row[i], c = down[i];
+            sortPair(a, b); sortPair(b, c); sortPair(a, b);
+            lows[i] = a;
+            middles[i] = b;
+            highs[i] = c;
+        }
+        const unsigned char* CPU_DISPATCH_RESTRICT l = lows;
+        const unsigned char* CPU_DISPATCH_RESTRICT m = middles;
+        const unsigned char* CPU_DISPATCH_RESTRICT h = highs;
+        const int c1 = channels, c2 = 2 * channels;
+        for (int i = 0; i < n; ++i) {
+            unsigned char low = std::max(std::max(l[i], l[i + c1]), l[i + c2]);
+            unsigned char middle = median3(m[i], m[i + c1], m[i + c2]);
+            unsigned char high = std::min(std::min(h[i], h[i + c1]), h[i + c2]);
+            output[begin + i] = median3(low, middle, high);
+        }
+    }
+}
+
+// Sub-function: 5 x 5 median of `count` interleaved values (as median3x3Row). Columns of
+// five are sorted once and shared by five outputs. Per output the five rank rows (lowest
+// of each column, second lowest, ...) are sorted as well; the entry at (rank row i, rank
+// column j) then has at least (i + 1)(j + 1) values <= it and (5 - i)(5 - j) values >= it,
+// which rules out all but 13 entries, and the median of those 13 (forgetful selection:
+// keep 8, drop the min and max, add the next, ...) is the median of the 25
+CPU_DISPATCH_INLINE void median5x5RowBody(const unsigned char* source,
+                                          size_t rowStride,
+                                          int channels,
+                                          int count,
+                                          unsigned char* CPU_DISPATCH_RESTRICT output) {
+    unsigned char ranks[5][CPU_DISPATCH_BLOCK + 4 * CPU_DISPATCH_MAX_CHANNELS];
+    for (int begin = 0; begin < count; begin += CPU_DISPATCH_BLOCK) {
+        const int n = std::min(CPU_DISPATCH_BLOCK, count - begin);
+        const int columns = n + 4 * channels;
+        const unsigned char* CPU_DISPATCH_RESTRICT row0 = source + begin;
+        const unsigned char* CPU_DISPATCH_RESTRICT row1 = row0 + rowStride;
+        const unsigned char* CPU_DISPATCH_RESTRICT row2 = row1 + rowStride;
+        const unsigned char* CPU_DISPATCH_RESTRICT row3 = row2 + rowStride;
+        const unsigned char* CPU_DISPATCH_RESTRICT row4 = row3 + rowStride;
+        for (int i = 0; i < columns; ++i) {
+            unsigned char v0 = row0[i], v1 = row1[i], v2 = row2[i], v3 = row3[i], v4 = row4[i];
+            sort5(v0, v1, v2, v3, v4);
+            ranks[0][i] = v0;
+            ranks[1][i] = v1;
+            ranks[2][i] = v2;
+            ranks[3][i] = v3;
+            ranks[4][i] = v4;
+        }
+
+        const unsigned char* CPU_DISPATCH_RESTRICT r0 = ranks[0];
+        const unsigned char* CPU_DISPATCH_RESTRICT r1 = ranks[1];
+        const unsigned char* CPU_DISPATCH_RESTRICT r2 = ranks[2];
+        const unsigned char* CPU_DISPATCH_RESTRICT r3 = ranks[3];
+        const unsigned char* CPU_DISPATCH_RESTRICT r4 = ranks[4];
+        const int c1 = channels, c2 = 2 * channels, c3 = 3 * channels, c4 = 4 * channels;
+        for (int i = 0; i < n; ++i) {
+            unsigned char a0 = r0[i], a1 = r0[i + c1], a2 = r0[i + c2], a3 = r0[i + c3], a4 = r0[i + c4];
+            unsigned char b0 = r1[i], b1 = r1[i + c1], b2 = r1[i + c2], b3 = r1[i + c3], b4 = r1[i + c4];
+            unsigned char d0 = r2[i], d1 = r2[i + c1], d2 = r2[i + c2], d3 = r2[i + c3], d4 = r2[i + c4];
+            unsigned char e0 = r3[i], e1 = r3[i + c1], e2 = r3[i + c2], e3 = r3[i + c3], e4 = r3[i + c4];
+            unsigned char f0 = r4[i], f1 = r4[i + c1], f2 = r4[i + c2], f3 = r4[i + c3], f4 = r4[i + c4];
+            sort5(a0, a1, a2, a3, a4);
+            sort5(b0, b1, b2, b3, b4);
+            sort5(d0, d1, d2, d3, d4);
+            sort5(e0, e1, e2, e3, e4);
+            sort5(f0, f1, f2, f3, f4);
+
+            // candidates: a3 a4 | b2 b3 b4 | d1 d2 d3 | e0 e1 e2 | f0 f1. Forgetful selection
+            // on m0..m5 plus one incoming value: the min goes to m<k>, the max to the incoming
+            unsigned char m0 = a3, m1 = b2, m2 = d1, m3 = d2, m4 = d3, m5 = e2;
+            unsigned char x = a4, y = b3;
+            sortPair(x, m0); sortPair(x, m1); sortPair(x, m2); sortPair(x, m3); sortPair(x, m4); sortPair(x, m5); sortPair(x, y);
+            sortPair(m0, y); sortPair(m1, y); sortPair(m2, y); sortPair(m3, y); sortPair(m4, y); sortPair(m5, y);
+            y = b4;
+            sortPair(m0, m1); sortPair(m0, m2); sortPair(m0, m3); sortPair(m0, m4); sortPair(m0, m5); sortPair(m0, y);
+            sortPair(m1, y); sortPair(m2, y); sortPair(m3, y); sortPair(m4, y); sortPair(m5, y);
+            y = e0;
+            sortPair(m1, m2); sortPair(m1, m3); sortPair(m1, m4); sortPair(m1, m5); sortPair(m1, y);
+            sortPair(m2, y); sortPair(m3, y); sortPair(m4, y); sortPair(m5, y);
+            y = e1;
+            sortPair(m2, m3); sortPair(m2, m4); sortPair(m2, m5); sortPair(m2, y);
+            sortPair(m3, y); sortPair(m4, y); sortPair(m5, y);
+            y = f0;
+            sortPair(m3, m4); sortPair(m3, m5); sortPair(m3, y);
+            sortPair(m4, y); sortPair(m5, y);
+            output[begin + i] = median3(m4, m5, f1);
+        }
+    }
+}
+
+// Sub-function: bilinear demosaic of columns [begin, end) of one row of a GRBG Bayer frame
+// (green where x + y is even, red on even rows). up, row and down are whole rows; the
+// caller handles the border columns
+CPU_DISPATCH_INLINE void demosaicRowBody(const unsigned char* CPU_DISPATCH_RESTRICT up,
+                                         const unsigned char* CPU_DISPATCH_RESTRICT row,
+                                         const unsigned char* CPU_DISPATCH_RESTRICT down,
+                                         int rowParity,
+                                         int begin,
+                                         int end,
+                                         int* CPU_DISPATCH_RESTRICT blue,
+                                         int* CPU_DISPATCH_RESTRICT green,
+                                         int* CPU_DISPATCH_RESTRICT red) {
+    const int oddRow = -(rowParity & 1);
+    for (int x = begin; x < end; ++x) {
+        int center = row[x];
+        int cross = (up[x] + down[x] + row[x - 1] + row[x + 1] + 2) / 4;
+        int diagonal = (up[x - 1] + up[x + 1] + down[x - 1] + down[x + 1] + 2) / 4;
+        int horizontal = (row[x - 1] + row[x + 1] + 1) / 2;
+        int vertical = (up[x] + down[x] + 1) / 2;
+
+        // chroma site: the sample is red on even rows, blue on odd rows. Selects are done
+        // with masks (all ones / all zeros) so the loop has no control flow
+        int chroma = -((x + rowParity) & 1);
+        int sameRow = (center & chroma) | (horizontal & ~chroma);   // color of this row's chroma sites
+        int otherRow = (diagonal & chroma) | (vertical & ~chroma);  // color of the other rows' chroma sites
+        green[x] = (cross & chroma) | (center & ~chroma);
+        red[x] = (otherRow & oddRow) | (sameRow & ~oddRow);
+        blue[x] = (sameRow & oddRow) | (otherRow & ~oddRow);
+    }
+}
+
+// Sub-function: BGR (0..255 ints) to planar Y/U/V bytes (BT.601 studio swing, truncated
+// after clamping, as in p1c/p1d)
+CPU_DISPATCH_INLINE void bgrToYuvRowBody(const int* CPU_DISPATCH_RESTRICT blue,
+                                         const int* CPU_DISPATCH_RESTRICT green,
+                                         const int* CPU_DISPATCH_RESTRICT red,
+                                         int count,
+                                         unsigned char* CPU_DISPATCH_RESTRICT yRow,
+                                         unsigned char* CPU_DISPATCH_RESTRICT uRow,
+                                         unsigned char* CPU_DISPATCH_RESTRICT vRow) {
+    for (int x = 0; x < count; ++x) {
+        double b = blue[x];
+        double g = green[x];
+        double r = red[x];
+        double y = 0.257 * r + 0.504 * g + 0.098 * b + 16;
+        double u = -0.148 * r - 0.291 * g + 0.439 * b + 128;
+        double v = 0.439 * r - 0.368 * g - 0.071 * b + 128;
+        yRow[x] = static_cast<unsigned char>(static_cast<int>(std::max(0.0, std::min(y, 255.0))));
+        uRow[x] = static_cast<unsigned char>(static_cast<int>(std::max(0.0, std::min(u, 255.0))));
+        vRow[x] = static_cast<unsigned char>(static_cast<int>(std::max(0.0, std::min(v, 255.0))));
+    }
+}
+
+// Sub-function: sum of squared differences (exact; 64-bit accumulator)
+CPU_DISPATCH_INLINE uint64_t sumSquaredDifferencesBody(const unsigned char* CPU_DISPATCH_RESTRICT a,
+                                                       const unsigned char* CPU_DISPATCH_RESTRICT b,
+                                                       size_t count) {
+    uint64_t total = 0;
+    for (size_t begin = 0; begin < count; begin += 65536) {
+        // 32-bit partial sums cannot overflow within a block of 2^16 values
+        size_t end = std::min(count, begin + 65536);
+        uint32_t partial = 0;
+        for (size_t i = begin; i < end; ++i) {
+            int d = a[i] - b[i];
+            partial += static_cast<uint32_t>(d * d);
+        }
+        total += partial;
+    }
+    return total;
+}
+
+// Sub-function: values[i] = e^arguments[i] at an ExpPrecision level (fastExp.h; the full level
+// calls std::exp per value)
+CPU_DISPATCH_INLINE void expRowBody(const float* CPU_DISPATCH_RESTRICT arguments,
+                                    int count,
+                                    int precision,
+                                    float* CPU_DISPATCH_RESTRICT values) {
+    if (precision == EXP_PRECISION_1E3) {
+        for (int i = 0; i < count; ++i) {
+            values[i] = fastExp3(arguments[i]);
+        }
+    } else if (precision == EXP_PRECISION_1E5) {
+        for (int i = 0; i < count; ++i) {
+            values[i] = fastExp4(arguments[i]);
+        }
+    } else {
+        for (int i = 0; i < count; ++i) {
+            values[i] = std::exp(arguments[i]);
+        }
+    }
+}
+
+#if defined(__clang__)
+#pragma float_control(pop)
+#endif
+
+// Dispatch table ==========================================================================
+
+struct CpuKernels {
+    CpuLevel level;
+    void (*histogram)(const unsigned char* data, int width, int height, size_t stride, int* bins);
+    void (*applyLut)(const unsigned char* input, unsigned char* output, size_t count, const unsigned char* lut);
+    void (*convolveRow)(const unsigned char* source, size_t rowStride, int channels, int count,
+                        const double* kernel, int kernelSize, unsigned char* output);
+    void (*bilateralRow)(const unsigned char* source, size_t rowStride, int channels, int count, const unsigned char* center,
+                         const double* spaceWeights, int kernelSize, const double* rangeWeights, unsigned char* output);
+    void (*median3x3Row)(const unsigned char* source, size_t rowStride, int channels, int count, unsigned char* output);
+    void (*median5x5Row)(const unsigned char* source, size_t rowStride, int channels, int count, unsigned char* output);
+    void (*demosaicRow)(const unsigned char* up, const unsigned char* row, const unsigned char* down,
+                        int rowParity, int begin, int end, int* blue, int* green, int* red);
+    void (*bgrToYuvRow)(const int* blue, const int* green, const int* red, int count,
+                        unsigned char* yRow, unsigned char* uRow, unsigned char* vRow);
+    uint64_t (*sumSquaredDifferences)(const unsigned char* a, const unsigned char* b, size_t count);
+    void (*expRow)(const float* arguments, int count, int precision, float* values);
+};
+
+// one set of wrappers per ISA level: same bodies, different target attributes
+#define CPU_DISPATCH_DEFINE_KERNELS(suffix, attributes)                                                           \
+    attributes inline void histogram##suffix(const unsigned char* data, int width, int height, size_t stride,     \
+                                             int* bins) {                                                         \
+        histogramBody(data, width, height, stride, bins);                                                         \
+    }                                                                                                             \
+    attributes inline void applyLut##suffix(const unsigned char* input, unsigned char* output, size_t count,      \
+                                            const unsigned char* lut) {                                           \
+        applyLutBody(input, output, count, lut);                                                                  \
+    }                                                                                                             \
+    attributes inline void convolveRow##suffix(const unsigned char* source, size_t rowStride, int channels,       \
+                                               int count, const double* kernel, int kernelSize,                   \
+                                               unsigned char* output) {                                           \
+        convolveRowBody(source, rowStride, channels, count, kernel, kernelSize, output);                          \
+    }                                                                                                             \
+    attributes inline void bilateralRow##suffix(const unsigned char* source, size_t rowStride, int channels,      \
+                                                int count, const unsigned char* center,                           \
+                                                const double* spaceWeights, int kernelSize,                       \
+                                                const double* rangeWeights, unsigned char* output) {              \
+        bilateralRowBody(source, rowStride, channels, count, center, spaceWeights, kernelSize, rangeWeights,      \
+                         output);                                                                                 \
+    }                                                                                                             \
+    attributes inline void median3x3Row##suffix(const unsigned char* source, size_t rowStride, int channels,      \
+                                                int count, unsigned char* output) {                               \
+        median3x3RowBody(source, rowStride, channels, count, output);                                             \
+    }                                                                                                             \
+    attributes inline void median5x5Row##suffix(const unsigned char* source, size_t rowStride, int channels,      \
+                                                int count, unsigned char* output) {                               \
+        median5x5RowBody(source, rowStride, channels, count, output);                                             \
+    }                                                                                                             \
+    attributes inline void demosaicRow##suffix(const unsigned char* up, const unsigned char* row,                 \
+                                               const unsigned char* down, int rowParity, int begin, int end,      \
+                                               int* blue, int* green, int* red) {                                 \
+        demosaicRowBody(up, row, down, rowParity, begin, end, blue, green, red);                                  \
+    }                                                                                                             \
+    attributes inline void bgrToYuvRow##suffix(const int* blue, const int* green, const int* red, int count,      \
+                                               unsigned char* yRow, unsigned char* uRow, unsigned char* vRow) {   \
+        bgrToYuvRowBody(blue, green, red, count, yRow, uRow, vRow);                                               \
+    }                                                                                                             \
+    attributes inline uint64_t sumSquaredDifferences##suffix(const unsigned char* a, const unsigned char* b,      \
+                                                             size_t count) {                                      \
+        return sumSquaredDifferencesBody(a, b, count);                                                            \
+    }                                                                                                             \
+    attributes inline void expRow##suffix(const float* arguments, int count, int precision, float* values) {      \
+        expRowBody(arguments, count, precision, values);                                                          \
+    }                                                                                                             \
+    inline CpuKernels cpuKernels##suffix(CpuLevel level) {                                                        \
+        CpuKernels kernels = {level, histogram##suffix, applyLut##suffix, convolveRow##suffix,                    \
+                              bilateralRow##suffix, median3x3Row##suffix, median5x5Row##suffix,                   \
+                              demosaicRow##suffix,                                                                \
+                              bgrToYuvRow##suffix, sumSquaredDifferences##suffix, expRow##suffix};                \
+        return kernels;                                                                                           \
+    }
+
+CPU_DISPATCH_DEFINE_KERNELS(Baseline, CPU_DISPATCH_VECTORIZE)
+#if defined(CPU_DISPATCH_X86)
+CPU_DISPATCH_DEFINE_KERNELS(SSE4, CPU_DISPATCH_VECTORIZE __attribute__((target("sse4.2"))))
+CPU_DISPATCH_DEFINE_KERNELS(AVX2, CPU_DISPATCH_VECTORIZE __attribute__((target("avx2"))))
+CPU_DISPATCH_DEFINE_KERNELS(AVX512, CPU_DISPATCH_VECTORIZE __attribute__((target("avx512f,avx512bw"))))
+#endif
+
+#undef CPU_DISPATCH_DEFINE_KERNELS
+
+// Helper function: name of a level, as accepted by CPU_DISPATCH
+inline const char* cpuLevelName(CpuLevel level) {
+    switch (level) {
+        case CPU_SSE4: return "sse4";
+        case CPU_AVX2: return "avx2";
+        case CPU_AVX512: return "avx512";
+        default: return "baseline";
+    }
+}
+
+// Function: widest level the host supports
+inline CpuLevel detectCpuLevel() {
+#if defined(CPU_DISPATCH_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return CPU_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return CPU_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return CPU_SSE4;
+    }
+#endif
+    return CPU_BASELINE;
+}
+
+// Function: kernel table for a level (clamped to what the host supports)
+inline CpuKernels cpuKernelsFor(CpuLevel level) {
+    level = std::min(level, detectCpuLevel());
+#if defined(CPU_DISPATCH_X86)
+    switch (level) {
+        case CPU_AVX512: return cpuKernelsAVX512(level);
+        case CPU_AVX2: return cpuKernelsAVX2(level);
+        case CPU_SSE4: return cpuKernelsSSE4(level);
+        default: break;
+    }
+#endif
+    return cpuKernelsBaseline(CPU_BASELINE);
+}
+
+// Function: the process-wide kernel table, bound on first use (CPU_DISPATCH overrides)
+inline const CpuKernels& cpuKernels() {
+    static const CpuKernels kernels = [] {
+        CpuLevel level = detectCpuLevel();
+        if (const char* requested = std::getenv("CPU_DISPATCH")) {
+            std::string name(requested);
+            for (CpuLevel candidate : {CPU_BASELINE, CPU_SSE4, CPU_AVX2, CPU_AVX512}) {
+                if (name == cpuLevelName(candidate)) {
+                    level = std::min(level, candidate);
+                }
+            }
+        }
+        return cpuKernelsFor(level);
+    }();
+    return kernels;
+}
+
+#endif // CPU_DISPATCH_H
@@ -0,0 +1,143 @@
+// Exact bucket filling: every pixel ranked, so the output histogram is flat
+//
+// Mapping by gray value sends all the pixels of one value to the same bucket, so a value
+// holding 3% of the image ends up in one bucket meant for 0.4%. Exact bucket filling ranks
+// the pixels themselves, by value and then by a tie-break, and gives rank r of N the value
+// floor(r * 256 / N): every bucket holds N / 256 pixels (rounded down or up when 256 does
+// not divide N). Tie-breaks:
+//   BUCKET_TIE_POSITION     raster order among equal values
+//   BUCKET_TIE_LOCAL_MEAN   the 3 x 3 mean (edges replicated) first, then raster order:
+//                           among equal values, pixels in brighter surroundings rank higher,
+//                           so the split follows the image instead of the scan
+// The ranking is made of stable counting sort passes, so it is O(N) and parallel: each
+// thread counts its contiguous share of the sequence into its own table, a prefix over
+// (key, thread) gives every thread its own run of ranks per key, and the threads hand them
+// out in sequence order, which keeps ties in that order. The position tie-break is one pass
+// by value over the raster order; the local-mean one is LSD radix order, a pass by the
+// 3 x 3 sum (2296 keys) and then a pass by value (256 keys) over the result, so the tables
+// stay small (9 KB per thread) however many threads run. Images must have fewer than 2^32
+// pixels.
+
+#ifndef EXACT_BUCKET_FILL_H
+#define EXACT_BUCKET_FILL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+enum BucketTieBreak {
+    BUCKET_TIE_POSITION,
+    BUCKET_TIE_LOCAL_MEAN
+};
+
+// Helper function: run body(thread, begin, end) over [0, count) split into `threads`
+// contiguous shares, one std::thread each (a single share runs on the calling thread)
+template <typename Body>
+void forEachShare(size_t count, int threads, Body body) {
+    if (threads == 1) {
+        body(0, size_t(0), count);
+        return;
+    }
+    std::vector<std::thread> workers;
+    const size_t share = (count + threads - 1) / threads;
+    for (int t = 0; t < threads; ++t) {
+        const size_t begin = std::min(count, t * share);
+        const size_t end = std::min(count, begin + share);
+        workers.emplace_back(body, t, begin, end);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Helper function: one stable parallel counting sort pass. Element j of the sequence has key
+// key(j) in [0, keyCount); place(j, rank) receives its position in the sorted order.
+template <typename Key, typename Place>
+void countingSortPass(size_t count, int keyCount, int threads, Key key, Place place) {
+    std::vector<uint32_t> counts(static_cast<size_t>(threads) * keyCount, 0);  // [thread][key]
+    forEachShare(count, threads, [&](int t, size_t begin, size_t end) {
+        uint32_t* threadCounts = &counts[static_cast<size_t>(t) * keyCount];
+        for (size_t j = begin; j < end; ++j) {
+            ++threadCounts[key(j)];
+        }
+    });
+
+    // first slot of every (key, thread): keys in order, threads in order within a key
+    uint32_t next = 0;
+    for (int k = 0; k < keyCount; ++k) {
+        for (int t = 0; t < threads; ++t) {
+            uint32_t& slot = counts[static_cast<size_t>(t) * keyCount + k];
+            const uint32_t threadCount = slot;
+            slot = next;
+            next += threadCount;
+        }
+    }
+
+    forEachShare(count, threads, [&](int t, size_t begin, size_t end) {
+        uint32_t* slots = &counts[static_cast<size_t>(t) * keyCount];
+        for (size_t j = begin; j < end; ++j) {
+            place(j, slots[key(j)]++);
+        }
+    });
+}
+
+// Function: exact bucket filling of a gray image in place (threads <= 0: one per core, at
+// most one per 4096 pixels)
+inline void exactBucketFill(std::vector<unsigned char>& image, int width, int height,
+                            BucketTieBreak tieBreak, int threads = 0) {
+    const size_t count = static_cast<size_t>(width) * height;
+    if (count == 0) {
+        return;
+    }
+    if (threads <= 0) {
+        threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    threads = static_cast<int>(std::min<size_t>(threads, (count + 4095) / 4096));
+    std::vector<unsigned char> output(count);
+    auto bucketOf = [count](int64_t rank) {
+        return static_cast<unsigned char>(rank * 256 / static_cast<int64_t>(count));
+    };
+
+    if (tieBreak == BUCKET_TIE_POSITION) {
+        // ranks straight from the value sort of the raster order
+        countingSortPass(count, 256, threads,
+            [&](size_t i) { return image[i]; },
+            [&](size_t i, int64_t rank) { output[i] = bucketOf(rank); });
+        image.swap(output);
+        return;
+    }
+
+    // 3 x 3 sums (0..2295) with replicated edges, rows split across the threads
+    std::vector<uint16_t> localSums(count);
+    forEachShare(height, threads, [&](int, size_t rowBegin, size_t rowEnd) {
+        for (int y = static_cast<int>(rowBegin); y < static_cast<int>(rowEnd); ++y) {
+            const unsigned char* rows[3] = {&image[std::max(y - 1, 0) * static_cast<size_t>(width)],
+                                            &image[y * static_cast<size_t>(width)],
+                                            &image[std::min(y + 1, height - 1) * static_cast<size_t>(width)]};
+            for (int x = 0; x < width; ++x) {
+                const int left = std::max(x - 1, 0);
+                const int right = std::min(x + 1, width - 1);
+                int sum = 0;
+                for (const unsigned char* row : rows) {
+                    sum += row[left] + row[x] + row[right];
+                }
+                localSums[y * static_cast<size_t>(width) + x] = static_cast<uint16_t>(sum);
+            }
+        }
+    });
+
+    // LSD order: the raster order sorted by local sum, then that order sorted by value
+    const int sumCount = 9 * 255 + 1;
+    std::vector<uint32_t> bySum(count);
+    countingSortPass(count, sumCount, threads,
+        [&](size_t i) { return localSums[i]; },
+        [&](size_t i, int64_t rank) { bySum[rank] = static_cast<uint32_t>(i); });
+    countingSortPass(count, 256, threads,
+        [&](size_t j) { return image[bySum[j]]; },
+        [&](size_t j, int64_t rank) { output[bySum[j]] = bucketOf(rank); });
+    image.swap(output);
+}
+
+#endif // EXACT_BUCKET_FILL_H
@@ -0,0 +1,103 @@
+// Fast exponentials with a bounded relative error, for filter weights
+//
+// exp(x) = 2^n * e^r with n = round(x / ln 2) and |r| <= ln 2 / 2 (Cody-Waite reduction with
+// a two-part ln 2), e^r from a polynomial fitted for minimal relative error on that
+// interval, and 2^n built directly in the exponent bits. Everything is plain float
+// arithmetic without branches or table lookups, so loops over arrays vectorize (the array
+// version is CpuKernels::expRow in cpuDispatch.h, compiled per ISA level).
+//
+// Accuracy levels, maximum relative error over x in [-87.3, 88] (measured over every float
+// in the range; below it the result goes to 0 by -87.7, where std::exp turns denormal, and
+// stays 0 down to -infinity; above it the result is infinity):
+//   EXP_PRECISION_1E3    degree 3    8e-5    (the 1e-3 level, with margin)
+//   EXP_PRECISION_1E5    degree 4    3e-6    (the 1e-5 level)
+//   EXP_PRECISION_FULL   std::exp    about 1 ulp
+// Weights with a relative error e move a normalized weighted mean of 8-bit values by at most
+// 2 * e * 255 before rounding: 0.04 gray levels at the 1e-3 level, 0.0015 at 1e-5.
+
+#ifndef FAST_EXP_H
+#define FAST_EXP_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FAST_EXP_INLINE __attribute__((always_inline)) inline
+#else
+#define FAST_EXP_INLINE inline
+#endif
+
+enum ExpPrecision {
+    EXP_PRECISION_1E3,
+    EXP_PRECISION_1E5,
+    EXP_PRECISION_FULL
+};
+
+// no FMA contraction, so every ISA level of CpuKernels::expRow gives the same bits (GCC gets
+// fp-contract=off from the expRow wrappers' optimize attribute, clang from this pragma)
+#if defined(__clang__)
+#pragma float_control(push)
+#pragma clang fp contract(off)
+#endif
+
+// Helper function: split x into n and r (x = n ln 2 + r) and return 2^n as a float. x is
+// first clamped to [-88, 88.7], so n stays in [-127, 128]: 2^n is 0 at n = -127 (x < -87.68,
+// down to -infinity) and infinity at n = 128. The clamps work on the bits of x, mapped to
+// integers in the order of the floats: a float compare would keep GCC from if-converting,
+// hence from vectorizing, the loops over arrays.
+FAST_EXP_INLINE float reduceExpArgument(float x, float& r) {
+    int32_t xBits;
+    std::memcpy(&xBits, &x, sizeof(xBits));
+    xBits ^= (xBits >> 31) & 0x7FFFFFFF;
+    xBits = xBits < -1118830593 ? -1118830593 : xBits;     // -88.0f
+    xBits = xBits > 1118922342 ? 1118922342 : xBits;       // 88.7f
+    xBits ^= (xBits >> 31) & 0x7FFFFFFF;
+    std::memcpy(&x, &xBits, sizeof(x));
+
+    // round to nearest by the 1.5 * 2^23 trick; the sum holds n in its low mantissa bits,
+    // read out as an integer instead of a float to int conversion
+    const float shifted = x * 1.44269504f + 12582912.0f;
+    int32_t shiftedBits;
+    std::memcpy(&shiftedBits, &shifted, sizeof(shiftedBits));
+    const float n = shifted - 12582912.0f;
+    r = (x - n * 0.693145751953125f) - n * 1.428606765330187e-6f;
+    const int32_t bits = (shiftedBits - 0x4B400000 + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+}
+
+// Function: e^x with relative error below 8e-5 (see the range above)
+FAST_EXP_INLINE float fastExp3(float x) {
+    float r;
+    const float scale = reduceExpArgument(x, r);
+    const float p = 0.999927998f + r * (1.00016212f + r * (0.504964769f + r * 0.165692374f));
+    return p * scale;
+}
+
+// Function: e^x with relative error below 3e-6 (see the range above)
+FAST_EXP_INLINE float fastExp4(float x) {
+    float r;
+    const float scale = reduceExpArgument(x, r);
+    const float p = 0.999999285f + r * (0.999963403f + r * (0.500043094f + r * (0.167909339f + r * 0.0414628386f)));
+    return p * scale;
+}
+
+// Function: e^x at the given accuracy level
+inline float fastExp(float x, ExpPrecision precision) {
+    switch (precision) {
+    case EXP_PRECISION_1E3:
+        return fastExp3(x);
+    case EXP_PRECISION_1E5:
+        return fastExp4(x);
+    default:
+        return std::exp(x);
+    }
+}
+
+#if defined(__clang__)
+#pragma float_control(pop)
+#endif
+
+#endif // FAST_EXP_H
@@ -0,0 +1,173 @@
+import socket
+import struct
+from multiprocessing import shared_memory
+
+import numpy as np
+
+# Python client of filterServer.cpp (protocol in filterService.h). The images live in one
+# shared memory segment that the server maps once per connection; requests only name them by
+# offset, so nothing is copied or pickled per call:
+#   import filterClient
+#   client = filterClient.FilterClient()          # server started with ./filterServer
+#   image = client.array((512, 768, 3))           # a numpy array inside the segment
+#   image[:] = np.fromfile('images/Flower.raw', np.uint8).reshape(512, 768, 3)
+#   client.median(image, 3, out=image)            # in place, same results as imageKernels.py
+# Inputs and outputs must come from client.array(); crops and views of them work too.
+
+SOCKET_PATH = '/tmp/imagekernels.sock'
+MAGIC = 0x31534b49
+NO_IMAGE = 0xffffffffffffffff
+(ATTACH, MEDIAN, GAUSSIAN, BILATERAL, GUIDED, HISTOGRAM, APPLY_LUT, MSE, PING) = range(1, 10)
+
+_REQUEST = struct.Struct('=I9i3Q2dQ48s')
+_RESPONSE = struct.Struct('=iidQ')
+_ERRORS = {-1: 'invalid arguments for image kernel', -3: 'bad request (image outside the segment?)',
+           -4: 'no segment attached', -5: 'the server could not attach the segment'}
+
+class FilterClient:
+    def __init__(self, capacity=64 << 20, socket_path=SOCKET_PATH):
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.connect(socket_path)
+        self._shm = shared_memory.SharedMemory(create=True, size=capacity)
+        self._buffer = np.frombuffer(self._shm.buf, dtype=np.uint8)
+        self._base = self._buffer.ctypes.data
+        self._used = 0
+        self._table = self.array((1, 256))          # apply_lut's table and histogram's bins
+        self._bins = self.array((4, 256), np.int64)
+        try:
+            # POSIX names carry a leading '/' that SharedMemory.name leaves out
+            self._call(ATTACH, segment_size=capacity, segment_name=('/' + self._shm.name).encode())
+        finally:
+            self._shm.unlink()   # the server has it mapped (or failed); nothing to leave behind
+        self.last_compute_ns = 0
+
+    def close(self):
+        self._socket.close()
+        self._buffer = self._table = self._bins = None
+        try:
+            self._shm.close()
+        except BufferError:
+            # arrays from array() are still alive: leave the mapping to them, and keep
+            # SharedMemory.__del__ from trying the close again
+            self._shm._buf = self._shm._mmap = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def array(self, shape, dtype=np.uint8):
+        # a new array in the segment (64-byte aligned); reset() releases all of them
+        size = int(np.prod(shape)) * np.dtype(dtype).itemsize
+        start = (self._used + 63) & ~63
+        if start + size > self._buffer.size:
+            raise MemoryError("shared segment full (capacity %d bytes)" % self._buffer.size)
+        self._used = start + size
+        return self._buffer[start:start + size].view(dtype).reshape(shape)
+
+    def reset(self):
+        # arrays from array() must not be used after this
+        self._used = self._bins.ctypes.data - self._base + self._bins.nbytes
+
+    def _offset(self, array, nbytes):
+        offset = array.ctypes.data - self._base
+        if offset < 0 or offset + nbytes > self._buffer.size:
+            raise ValueError("arrays must come from FilterClient.array()")
+        return offset
+
+    def _describe(self, image):
+        # (offset, row stride, width, height, channels) of a uint8 image in the segment
+        if image.dtype != np.uint8 or image.ndim not in (2, 3):
+            raise ValueError("Expected a uint8 array of shape (height, width) or (height, width, channels)")
+        height, width = image.shape[:2]
+        channels = image.shape[2] if image.ndim == 3 else 1
+        if image.strides[-1] != 1 or (image.ndim == 3 and image.strides[1] != channels) or image.strides[0] <= 0:
+            raise ValueError("Pixels must be contiguous within each row")
+        offset = self._offset(image, (height - 1) * image.strides[0] + width * channels)
+        return offset, image.strides[0], width, height, channels
+
+    def _output(self, image, out):
+        if out is None:
+            return self.array(image.shape)
+        if out.shape != image.shape:
+            raise ValueError("out must have the shape of the input")
+        return out
+
+    def _call(self, op, image=None, out=None, aux=None, size=0, param1=0.0, param2=0.0,
+              segment_size=0, segment_name=b''):
+        src = dst = 0
+        src_stride = dst_stride = aux_stride = aux_channels = width = height = channels = 0
+        aux_offset = NO_IMAGE
+        if image is not None:
+            src, src_stride, width, height, channels = self._describe(image)
+        if out is not None:
+            dst, dst_stride = self._describe(out)[:2] if out.dtype == np.uint8 else (self._offset(out, out.nbytes), 0)
+        if aux is not None:
+            aux_offset, aux_stride, _, _, aux_channels = self._describe(aux)
+        self._socket.sendall(_REQUEST.pack(MAGIC, op, width, height, channels, size, src_stride, dst_stride,
+                                           aux_stride, aux_channels, src, dst, aux_offset, param1, param2,
+                                           segment_size, segment_name))
+        status, _, value, self.last_compute_ns = _RESPONSE.unpack(self._receive(_RESPONSE.size))
+        if status == -2:
+            raise MemoryError("image kernel ran out of memory")
+        if status != 0:
+            raise ValueError(_ERRORS.get(status, "filter server error %d" % status))
+        return value
+
+    def _receive(self, size):
+        data = b''
+        while len(data) < size:
+            chunk = self._socket.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError("filter server closed the connection")
+            data += chunk
+        return data
+
+    def ping(self):
+        self._call(PING)
+
+    def median(self, image, kernel_size=3, out=None):
+        out = self._output(image, out)
+        self._call(MEDIAN, image, out, size=kernel_size)
+        return out
+
+    def gaussian(self, image, kernel_size, sigma, out=None):
+        out = self._output(image, out)
+        self._call(GAUSSIAN, image, out, size=kernel_size, param1=sigma)
+        return out
+
+    def bilateral(self, image, kernel_size, sigma_color, sigma_space, out=None):
+        out = self._output(image, out)
+        self._call(BILATERAL, image, out, size=kernel_size, param1=sigma_color, param2=sigma_space)
+        return out
+
+    def guided(self, image, radius, eps, guide=None, out=None):
+        if guide is not None and guide.shape[:2] != image.shape[:2]:
+            raise ValueError("guide must have the width and height of the input")
+        out = self._output(image, out)
+        self._call(GUIDED, image, out, aux=guide, size=radius, param1=eps)
+        return out
+
+    def histogram(self, image):
+        # shape (256,) for a gray image, (channels, 256) otherwise
+        channels = image.shape[2] if image.ndim == 3 else 1
+        bins = self._bins[:channels]
+        bins[:] = 0
+        self._call(HISTOGRAM, image, bins)
+        return bins[0].copy() if image.ndim == 2 else bins.copy()
+
+    def apply_lut(self, image, lut, out=None):
+        self._table[0] = np.asarray(lut, dtype=np.uint8).reshape(256)
+        out = self._output(image, out)
+        self._call(APPLY_LUT, image, out, aux=self._table)
+        return out
+
+    def mse(self, a, b):
+        if a.shape != b.shape:
+            raise ValueError("Images must have the same size for MSE calculation.")
+        return self._call(MSE, a, aux=b)
+
+    def psnr(self, a, b):
+        error = self.mse(a, b)
+        return float('inf') if error == 0 else 10 * np.log10(255.0 * 255.0 / error)
@@ -0,0 +1,506 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/stat.h>
+
+#include "filterService.h"
+
+// Local filter daemon: serves the kernels of imageKernels.cpp over a Unix domain socket, on
+// images in shared memory segments attached by the clients (protocol in filterService.h,
+// Python client in filterClient.py).
+//   g++ -std=c++17 -O2 -pthread filterServer.cpp imageKernels.cpp -o filterServer   (-lrt on old glibc)
+//   ./filterServer [socket]         serve until SIGINT / SIGTERM (default /tmp/imagekernels.sock)
+//   ./filterServer bench [socket]   round-trip latency of 768 x 512 requests against a running server
+//
+// A process per call pays for start-up, reading the image and building kernels and scratch
+// each time; the server keeps all of that warm. One poll loop watches the listener and every
+// connection and queues each complete request to a fixed pool of worker threads started once,
+// so an idle connection holds no worker. The kernel caches (weights, guided filter plan,
+// padded scratch; imageKernels.cpp) belong to the worker thread and stay from one request to
+// the next, whichever connection it comes from, and the segment is mapped once per
+// connection, so a request costs two small socket messages on top of the kernel itself.
+
+// image dimensions of the benchmark
+const int WIDTH = 768;
+const int HEIGHT = 512;
+
+// requests per operation in the benchmark (fewer for slow operations: about 2 s each at most)
+const int BENCH_REQUESTS = 1000;
+
+std::atomic<bool> stopRequested(false);
+
+// Helper function: SIGINT / SIGTERM
+void requestStop(int) {
+    stopRequested.store(true);
+}
+
+// Helper function: nanoseconds on the steady clock
+uint64_t nowNanoseconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Server side mapping of a client's segment
+struct AttachedSegment {
+    unsigned char* base = nullptr;
+    size_t size = 0;
+};
+
+// Helper function: does a width x height x channels image at `offset` with row stride `stride`
+// lie inside the segment (sizes are bounded first, so nothing overflows)
+bool imageInSegment(const AttachedSegment& segment, uint64_t offset, int stride, int width, int height,
+                    int channels) {
+    if (width <= 0 || height <= 0 || channels <= 0 || width > (1 << 16) || height > (1 << 16) || channels > 4 ||
+        stride < width * channels || offset > segment.size) {
+        return false;
+    }
+    const uint64_t extent = static_cast<uint64_t>(height - 1) * static_cast<uint64_t>(stride) +
+                            static_cast<uint64_t>(width) * channels;
+    return extent <= segment.size - offset;
+}
+
+// Helper function: map the segment named by an FILTER_ATTACH request (replacing any earlier one)
+int attachSegment(AttachedSegment& segment, const FilterRequest& request) {
+    char name[sizeof(request.segmentName) + 1];
+    std::memcpy(name, request.segmentName, sizeof(request.segmentName));
+    name[sizeof(request.segmentName)] = '\0';
+    if (segment.base != nullptr) {
+        ::munmap(segment.base, segment.size);
+        segment.base = nullptr;
+        segment.size = 0;
+    }
+
+    int fd = ::shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return FILTER_ATTACH_FAILED;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || request.segmentSize == 0 ||
+        request.segmentSize > static_cast<uint64_t>(info.st_size)) {
+        ::close(fd);
+        return FILTER_ATTACH_FAILED;
+    }
+    void* mapping = ::mmap(nullptr, request.segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return FILTER_ATTACH_FAILED;
+    }
+    segment.base = static_cast<unsigned char*>(mapping);
+    segment.size = request.segmentSize;
+    return IK_OK;
+}
+
+// Function: run one request on the attached segment
+FilterResponse handleRequest(AttachedSegment& segment, const FilterRequest& request) {
+    FilterResponse response;
+    std::memset(&response, 0, sizeof(response));
+    if (request.magic != FILTER_SERVICE_MAGIC) {
+        response.status = FILTER_BAD_REQUEST;
+        return response;
+    }
+    if (request.op == FILTER_ATTACH) {
+        response.status = attachSegment(segment, request);
+        return response;
+    }
+    if (request.op == FILTER_PING) {
+        response.status = IK_OK;
+        return response;
+    }
+    if (segment.base == nullptr) {
+        response.status = FILTER_NOT_ATTACHED;
+        return response;
+    }
+
+    // every image the operation touches must lie inside the segment
+    const int width = request.width;
+    const int height = request.height;
+    const int channels = request.channels;
+    bool valid = imageInSegment(segment, request.src, request.srcStride, width, height, channels);
+    switch (request.op) {
+    case FILTER_MEDIAN:
+    case FILTER_GAUSSIAN:
+    case FILTER_BILATERAL:
+        valid = valid && imageInSegment(segment, request.dst, request.dstStride, width, height, channels);
+        break;
+    case FILTER_GUIDED:
+        valid = valid && imageInSegment(segment, request.dst, request.dstStride, width, height, channels) &&
+                (request.aux == FILTER_NO_IMAGE ||
+                 imageInSegment(segment, request.aux, request.auxStride, width, height, request.auxChannels));
+        break;
+    case FILTER_HISTOGRAM:
+        valid = valid && request.dst % alignof(int64_t) == 0 &&
+                imageInSegment(segment, request.dst, 256 * sizeof(int64_t), 256 * sizeof(int64_t), channels, 1);
+        break;
+    case FILTER_APPLY_LUT:
+        valid = valid && imageInSegment(segment, request.dst, request.dstStride, width, height, channels) &&
+                imageInSegment(segment, request.aux, 256, 256, 1, 1);
+        break;
+    case FILTER_MSE:
+        valid = valid && imageInSegment(segment, request.aux, request.auxStride, width, height, channels);
+        break;
+    default:
+        valid = false;
+    }
+    if (!valid) {
+        response.status = FILTER_BAD_REQUEST;
+        return response;
+    }
+
+    const uint8_t* src = segment.base + request.src;
+    uint8_t* dst = segment.base + request.dst;
+    uint8_t* aux = request.aux == FILTER_NO_IMAGE ? nullptr : segment.base + request.aux;
+    const uint64_t start = nowNanoseconds();
+    switch (request.op) {
+    case FILTER_MEDIAN:
+        response.status = ik_median(src, request.srcStride, dst, request.dstStride, width, height, channels,
+                                    request.size);
+        break;
+    case FILTER_GAUSSIAN:
+        response.status = ik_gaussian(src, request.srcStride, dst, request.dstStride, width, height, channels,
+                                      request.size, request.param1);
+        break;
+    case FILTER_BILATERAL:
+        response.status = ik_bilateral(src, request.srcStride, dst, request.dstStride, width, height, channels,
+                                       request.size, request.param1, request.param2);
+        break;
+    case FILTER_GUIDED:
+        response.status = ik_guided(src, request.srcStride, dst, request.dstStride, width, height, channels,
+                                    aux, request.auxStride, request.auxChannels, request.size, request.param1);
+        break;
+    case FILTER_HISTOGRAM:
+        response.status = ik_histogram(src, request.srcStride, width, height, channels,
+                                       reinterpret_cast<int64_t*>(dst));
+        break;
+    case FILTER_APPLY_LUT:
+        response.status = ik_apply_lut(src, request.srcStride, dst, request.dstStride, width, height, channels, aux);
+        break;
+    case FILTER_MSE:
+        response.status = ik_mse(src, request.srcStride, aux, request.auxStride, width, height, channels,
+                                 &response.value);
+        break;
+    }
+    response.computeNanoseconds = nowNanoseconds() - start;
+    return response;
+}
+
+// Server side of one connection: the socket, its segment and the request being received.
+// While a worker holds its request the connection stays out of the poll set, so each
+// connection has at most one request in flight and its requests run in order.
+struct ClientConnection {
+    int socket = -1;
+    AttachedSegment segment;
+    FilterRequest request;
+    size_t received = 0;                // bytes of `request` read so far
+    bool closed = false;                // end of stream or a receive error (poll loop only)
+    std::atomic<bool> busy{false};      // a worker holds the request; it clears this when done
+    std::atomic<bool> failed{false};    // the response could not be sent
+};
+
+// A complete request and the connection to answer it on
+struct WorkItem {
+    ClientConnection* connection;
+    FilterRequest request;
+};
+
+// Received requests waiting for a worker
+struct RequestQueue {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<WorkItem> items;
+    bool closing = false;
+    int wakeFd = -1;    // write end of the pipe that puts an answered connection back in the poll set
+};
+
+// Function: worker thread, started once; answers queued requests until the queue closes
+void workerLoop(RequestQueue& queue) {
+    for (;;) {
+        WorkItem item;
+        {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.ready.wait(lock, [&] { return queue.closing || !queue.items.empty(); });
+            if (queue.closing) {
+                return;
+            }
+            item = queue.items.front();
+            queue.items.pop_front();
+        }
+        ClientConnection& connection = *item.connection;
+        FilterResponse response = handleRequest(connection.segment, item.request);
+        if (!sendAll(connection.socket, &response, sizeof(response))) {
+            connection.failed.store(true);
+        }
+        connection.busy.store(false);
+        const char wake = 0;
+        while (::write(queue.wakeFd, &wake, 1) < 0 && errno == EINTR) {
+        }
+    }
+}
+
+// Helper function: read what has arrived of a connection's next request without blocking;
+// queue the request once it is complete
+void receiveRequest(ClientConnection& connection, RequestQueue& queue) {
+    char* bytes = reinterpret_cast<char*>(&connection.request);
+    ssize_t received = ::recv(connection.socket, bytes + connection.received,
+                              sizeof(connection.request) - connection.received, MSG_DONTWAIT);
+    if (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (received <= 0) {
+        connection.closed = true;
+        return;
+    }
+    connection.received += static_cast<size_t>(received);
+    if (connection.received < sizeof(connection.request)) {
+        return;
+    }
+    connection.received = 0;
+    connection.busy.store(true);
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.items.push_back({&connection, connection.request});
+    queue.ready.notify_one();
+}
+
+// Helper function: close a connection and unmap its segment
+void closeConnection(ClientConnection& connection) {
+    if (connection.segment.base != nullptr) {
+        ::munmap(connection.segment.base, connection.segment.size);
+    }
+    ::close(connection.socket);
+}
+
+// Function: listen on socketPath and serve until SIGINT / SIGTERM
+int runServer(const std::string& socketPath) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return 1;
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(socketPath.c_str());   // a socket left behind by a server that did not shut down
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, 64) != 0) {
+        std::cerr << "Cannot listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    ::chmod(socketPath.c_str(), 0600);
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    ::sigaction(SIGINT, &action, nullptr);
+    ::sigaction(SIGTERM, &action, nullptr);
+    ::signal(SIGPIPE, SIG_IGN);   // a client gone mid-response is an error return, not a signal
+
+    int wakePipe[2];
+    if (::pipe(wakePipe) != 0) {
+        std::cerr << "Cannot create the wake-up pipe: " << std::strerror(errno) << std::endl;
+        ::close(listener);
+        return 1;
+    }
+    ::fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+
+    RequestQueue queue;
+    queue.wakeFd = wakePipe[1];
+    const int workerCount = static_cast<int>(std::max(2u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> workers;
+    for (int i = 0; i < workerCount; ++i) {
+        workers.emplace_back(workerLoop, std::ref(queue));
+    }
+    std::cout << "Filter server on " << socketPath << " (" << workerCount << " workers, "
+              << ik_cpu_level() << " kernels)" << std::endl;
+
+    // one poll over the listener, the wake-up pipe and every connection without a request in
+    // flight; the timeout lets a stop request be seen without any traffic
+    std::vector<std::unique_ptr<ClientConnection>> connections;
+    std::vector<pollfd> polled;
+    std::vector<ClientConnection*> polledConnections;
+    while (!stopRequested.load()) {
+        // drop the connections their clients closed, once no worker holds them
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+            [](const std::unique_ptr<ClientConnection>& connection) {
+                if (connection->busy.load() || !(connection->closed || connection->failed.load())) {
+                    return false;
+                }
+                closeConnection(*connection);
+                return true;
+            }), connections.end());
+
+        polled.assign({{listener, POLLIN, 0}, {wakePipe[0], POLLIN, 0}});
+        polledConnections.clear();
+        for (const std::unique_ptr<ClientConnection>& connection : connections) {
+            if (!connection->busy.load() && !connection->closed) {
+                polled.push_back({connection->socket, POLLIN, 0});
+                polledConnections.push_back(connection.get());
+            }
+        }
+        if (::poll(polled.data(), polled.size(), 200) <= 0) {
+            continue;
+        }
+
+        if (polled[1].revents != 0) {
+            char drained[64];
+            while (::read(wakePipe[0], drained, sizeof(drained)) > 0) {
+            }
+        }
+        for (size_t i = 0; i < polledConnections.size(); ++i) {
+            if (polled[i + 2].revents != 0) {
+                receiveRequest(*polledConnections[i], queue);
+            }
+        }
+        if (polled[0].revents & POLLIN) {
+            int socket = ::accept(listener, nullptr, nullptr);
+            if (socket >= 0) {
+                connections.emplace_back(new ClientConnection);
+                connections.back()->socket = socket;
+            }
+        }
+    }
+
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.closing = true;
+        queue.items.clear();
+    }
+    queue.ready.notify_all();
+    // requests in progress are short: wait for them, then close every connection
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const std::unique_ptr<ClientConnection>& connection : connections) {
+        closeConnection(*connection);
+    }
+    ::close(wakePipe[0]);
+    ::close(wakePipe[1]);
+    std::cout << "Filter server stopped." << std::endl;
+    return 0;
+}
+
+// Helper function: print round-trip statistics of one operation
+void reportLatency(const char* name, std::vector<uint64_t>& roundTrips, std::vector<uint64_t>& overheads,
+                   uint64_t computeTotal) {
+    std::sort(roundTrips.begin(), roundTrips.end());
+    std::sort(overheads.begin(), overheads.end());
+    const size_t count = roundTrips.size();
+    std::cout << "  " << name << std::string(12 - std::min<size_t>(std::strlen(name), 11), ' ')
+              << count << " requests, compute " << computeTotal / count / 1000.0 << " us, round trip "
+              << roundTrips[count / 2] / 1000.0 << " us; overhead median " << overheads[count / 2] / 1000.0
+              << " us, p99 " << overheads[count * 99 / 100] / 1000.0 << " us" << std::endl;
+}
+
+// Function: latency of the service on WIDTH x HEIGHT images (overhead = round trip - compute)
+int runBenchmark(const std::string& socketPath) {
+    const size_t imageBytes = static_cast<size_t>(WIDTH) * HEIGHT * 3;
+    FilterConnection connection;
+    if (!openFilterConnection(connection, 4 * imageBytes + 4096, socketPath.c_str())) {
+        return 1;
+    }
+
+    // segment layout: input, output, second image, LUT, histogram bins
+    unsigned char* input = connection.segment;
+    unsigned char* output = input + imageBytes;
+    unsigned char* other = output + imageBytes;
+    unsigned char* lut = other + imageBytes;
+    unsigned char* bins = lut + 256;
+    std::ifstream file("./images/Flower.raw", std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(input), imageBytes)) {
+        std::cout << "images/Flower.raw not found, using a synthetic image" << std::endl;
+        for (size_t i = 0; i < imageBytes; ++i) {
+            input[i] = static_cast<unsigned char>((i * 7 + (i / (WIDTH * 3)) * 13) & 255);
+        }
+    }
+    std::memcpy(other, input, imageBytes);
+    for (int v = 0; v < 256; ++v) {
+        lut[v] = static_cast<unsigned char>(255 - v);
+    }
+
+    FilterRequest base;
+    std::memset(&base, 0, sizeof(base));
+    base.width = WIDTH;
+    base.height = HEIGHT;
+    base.channels = 3;
+    base.srcStride = base.dstStride = base.auxStride = WIDTH * 3;
+    base.src = segmentOffset(connection, input);
+    base.dst = segmentOffset(connection, output);
+    base.aux = FILTER_NO_IMAGE;
+
+    struct BenchCase {
+        const char* name;
+        int op;
+        int size;
+        double param1;
+        double param2;
+        uint64_t dst;
+        uint64_t aux;
+    };
+    const BenchCase cases[] = {
+        {"ping", FILTER_PING, 0, 0, 0, base.dst, FILTER_NO_IMAGE},
+        {"median 3", FILTER_MEDIAN, 3, 0, 0, base.dst, FILTER_NO_IMAGE},
+        {"gaussian 5", FILTER_GAUSSIAN, 5, 1.0, 0, base.dst, FILTER_NO_IMAGE},
+        {"bilateral 5", FILTER_BILATERAL, 5, 25.0, 2.0, base.dst, FILTER_NO_IMAGE},
+        {"guided 2", FILTER_GUIDED, 2, 100.0, 0, base.dst, FILTER_NO_IMAGE},
+        {"histogram", FILTER_HISTOGRAM, 0, 0, 0, segmentOffset(connection, bins), FILTER_NO_IMAGE},
+        {"apply lut", FILTER_APPLY_LUT, 0, 0, 0, base.dst, segmentOffset(connection, lut)},
+        {"mse", FILTER_MSE, 0, 0, 0, base.dst, segmentOffset(connection, other)},
+    };
+
+    std::cout << "Filter service latency, " << WIDTH << " x " << HEIGHT << " x 3:" << std::endl;
+    for (const BenchCase& benchCase : cases) {
+        FilterRequest request = base;
+        request.op = benchCase.op;
+        request.size = benchCase.size;
+        request.param1 = benchCase.param1;
+        request.param2 = benchCase.param2;
+        request.dst = benchCase.dst;
+        request.aux = benchCase.aux;
+
+        // the first call builds the worker's caches; then at most about 2 s per operation
+        FilterResponse response = callFilterServer(connection, request);
+        if (response.status != IK_OK) {
+            std::cerr << benchCase.name << " failed with status " << response.status << std::endl;
+            closeFilterConnection(connection);
+            return 1;
+        }
+        const int requests = std::max(20, std::min<int>(BENCH_REQUESTS,
+            static_cast<int>(2e9 / std::max<uint64_t>(response.computeNanoseconds, 1))));
+        std::vector<uint64_t> roundTrips, overheads;
+        uint64_t computeTotal = 0;
+        for (int i = 0; i < requests; ++i) {
+            const uint64_t start = nowNanoseconds();
+            response = callFilterServer(connection, request);
+            const uint64_t roundTrip = nowNanoseconds() - start;
+            roundTrips.push_back(roundTrip);
+            overheads.push_back(roundTrip - std::min(roundTrip, response.computeNanoseconds));
+            computeTotal += response.computeNanoseconds;
+        }
+        reportLatency(benchCase.name, roundTrips, overheads, computeTotal);
+    }
+
+    closeFilterConnection(connection);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const bool bench = argc > 1 && std::strcmp(argv[1], "bench") == 0;
+    const int pathArgument = bench ? 2 : 1;
+    const std::string socketPath = argc > pathArgument ? argv[pathArgument] : FILTER_SERVICE_SOCKET;
+    return bench ? runBenchmark(socketPath) : runServer(socketPath);
+}
@@ -0,0 +1,202 @@
+// Local filter service: wire protocol and C++ client of filterServer.cpp
+//
+// A client connects to the server's Unix domain socket, creates a shared memory segment
+// (shm_open) and attaches it by name. Images then live in that segment and a request names
+// them by byte offset, so only the fixed-size request and response structs cross the socket;
+// the server runs the kernels of imageKernels.cpp (same arguments, same results, output may
+// alias input) directly on its mapping of the segment. The segment is unlinked as soon as the
+// server has mapped it, so it disappears with the last of the two processes.
+//
+// Messages are native structs (both ends are on the same host): a FilterRequest, answered by
+// one FilterResponse, strictly in turn on each connection. filterClient.py speaks the same
+// protocol from Python.
+
+#ifndef FILTER_SERVICE_H
+#define FILTER_SERVICE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "imageKernels.h"
+
+const char* const FILTER_SERVICE_SOCKET = "/tmp/imagekernels.sock";
+const uint32_t FILTER_SERVICE_MAGIC = 0x31534b49;   // "IKS1"
+const uint64_t FILTER_NO_IMAGE = ~0ull;             // aux: no guide (self-guided filter)
+
+enum FilterOp {
+    FILTER_ATTACH = 1,      // map segmentName (segmentSize bytes) for the rest of the connection
+    FILTER_MEDIAN,          // size = kernel size
+    FILTER_GAUSSIAN,        // size = kernel size, param1 = sigma
+    FILTER_BILATERAL,       // size = kernel size, param1 = sigma color, param2 = sigma space
+    FILTER_GUIDED,          // size = radius, param1 = eps, aux = guide (or FILTER_NO_IMAGE)
+    FILTER_HISTOGRAM,       // dst = channels x 256 int64 bins (added to)
+    FILTER_APPLY_LUT,       // aux = 256-byte table
+    FILTER_MSE,             // aux = second image; the result is in FilterResponse::value
+    FILTER_PING             // no work: the bare round trip
+};
+
+// status codes beyond those of imageKernels.h
+enum {
+    FILTER_BAD_REQUEST = -3,    // unknown op, wrong magic, image outside the segment
+    FILTER_NOT_ATTACHED = -4,   // image request before FILTER_ATTACH
+    FILTER_ATTACH_FAILED = -5   // segment missing, too small or not mappable
+};
+
+// 136 bytes, no padding (Python: struct '=I9i3Q2dQ48s')
+struct FilterRequest {
+    uint32_t magic;
+    int32_t op;
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t size;
+    int32_t srcStride;
+    int32_t dstStride;
+    int32_t auxStride;
+    int32_t auxChannels;
+    uint64_t src;           // byte offsets in the segment
+    uint64_t dst;
+    uint64_t aux;
+    double param1;
+    double param2;
+    uint64_t segmentSize;   // FILTER_ATTACH
+    char segmentName[48];   // FILTER_ATTACH: shm_open name ("/...")
+};
+
+// 24 bytes (Python: struct '=iidQ')
+struct FilterResponse {
+    int32_t status;
+    int32_t reserved;
+    double value;
+    uint64_t computeNanoseconds;    // spent in the kernel, for telling it from transport
+};
+
+// Helper function: write / read exactly `size` bytes (false on error or end of stream)
+inline bool sendAll(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = ::send(fd, bytes, size, 0);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+inline bool receiveAll(int fd, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t received = ::recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+// Client side: one socket connection and its attached segment
+struct FilterConnection {
+    int socket = -1;
+    unsigned char* segment = nullptr;
+    size_t segmentSize = 0;
+};
+
+// Function: connect to the server and attach a fresh segment of segmentSize bytes
+inline bool openFilterConnection(FilterConnection& connection, size_t segmentSize,
+                                 const char* socketPath = FILTER_SERVICE_SOCKET) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath);
+    connection.socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection.socket < 0 ||
+        ::connect(connection.socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::fprintf(stderr, "Cannot connect to the filter server at %s\n", socketPath);
+        return false;
+    }
+
+    FilterRequest request;
+    std::memset(&request, 0, sizeof(request));
+    std::snprintf(request.segmentName, sizeof(request.segmentName), "/ik-%d-%d",
+                  static_cast<int>(::getpid()), connection.socket);
+    int fd = ::shm_open(request.segmentName, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(segmentSize)) != 0) {
+        std::fprintf(stderr, "Cannot create the shared memory segment %s\n", request.segmentName);
+        if (fd >= 0) {
+            ::close(fd);
+            ::shm_unlink(request.segmentName);
+        }
+        return false;
+    }
+    void* mapping = ::mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        ::shm_unlink(request.segmentName);
+        return false;
+    }
+    connection.segment = static_cast<unsigned char*>(mapping);
+    connection.segmentSize = segmentSize;
+
+    request.magic = FILTER_SERVICE_MAGIC;
+    request.op = FILTER_ATTACH;
+    request.segmentSize = segmentSize;
+    FilterResponse response;
+    bool attached = sendAll(connection.socket, &request, sizeof(request)) &&
+                    receiveAll(connection.socket, &response, sizeof(response)) && response.status == IK_OK;
+    ::shm_unlink(request.segmentName);   // both sides hold a mapping now
+    if (!attached) {
+        std::fprintf(stderr, "The filter server could not attach %s\n", request.segmentName);
+    }
+    return attached;
+}
+
+// Function: byte offset of a pointer into the attached segment
+inline uint64_t segmentOffset(const FilterConnection& connection, const void* pointer) {
+    return static_cast<uint64_t>(static_cast<const unsigned char*>(pointer) - connection.segment);
+}
+
+// Function: send one request and wait for its response (status IK_OK on success)
+inline FilterResponse callFilterServer(FilterConnection& connection, FilterRequest request) {
+    request.magic = FILTER_SERVICE_MAGIC;
+    FilterResponse response;
+    std::memset(&response, 0, sizeof(response));
+    if (!sendAll(connection.socket, &request, sizeof(request)) ||
+        !receiveAll(connection.socket, &response, sizeof(response))) {
+        response.status = FILTER_BAD_REQUEST;
+    }
+    return response;
+}
+
+// Function: close the connection and unmap the segment
+inline void closeFilterConnection(FilterConnection& connection) {
+    if (connection.segment != nullptr) {
+        ::munmap(connection.segment, connection.segmentSize);
+        connection.segment = nullptr;
+    }
+    if (connection.socket >= 0) {
+        ::close(connection.socket);
+        connection.socket = -1;
+    }
+}
+
+#endif // FILTER_SERVICE_H
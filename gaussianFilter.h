@@ -0,0 +1,267 @@
+// Gaussian filter plan for interleaved images and planes (p2d, p3)
+//
+// One plan per (shape, channel count, kernel size, sigma) picks an implementation once and
+// owns its work buffers, so executing it allocates nothing:
+//   GAUSSIAN_DIRECT        normalized kernelSize x kernelSize kernel; the interior runs
+//                          through the dispatched row kernel (cpuDispatch.h), the border
+//                          clamps its reads (edges replicated)
+//   GAUSSIAN_FIXED_POINT   the same kernel in Q-format integer SIMD (fixedPointConvolution.h)
+//   GAUSSIAN_FFT           overlap-save FFT convolution, edges replicated (fftConvolution.h)
+//   GAUSSIAN_RECURSIVE     Young - van Vliet IIR at any sigma (recursiveGaussian.h)
+// GAUSSIAN_AUTO takes the recursive filter from settings.recursiveSigma up (an accuracy
+// choice: the kernel window no longer holds the Gaussian) and otherwise auto-tunes the
+// candidates near the measured crossovers, or uses the crossover constants.
+
+#ifndef GAUSSIAN_FILTER_H
+#define GAUSSIAN_FILTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "autoTuner.h"
+#include "cpuDispatch.h"
+#include "fftConvolution.h"
+#include "fixedPointConvolution.h"
+#include "recursiveGaussian.h"
+
+// Gaussian filter implementations; GAUSSIAN_AUTO lets chooseGaussianVariant pick one
+enum GaussianVariant {
+    GAUSSIAN_AUTO,
+    GAUSSIAN_DIRECT,
+    GAUSSIAN_FIXED_POINT,
+    GAUSSIAN_FFT,
+    GAUSSIAN_RECURSIVE
+};
+
+// Helper struct: a program's choices for GAUSSIAN_AUTO (its RECURSIVE_GAUSSIAN_SIGMA,
+// FIXED_POINT_MODE and AUTO_TUNE)
+struct GaussianFilterSettings {
+    double recursiveSigma;      // sigma from which the recursive filter is used
+    bool fixedPoint;            // the fixed-point path is a candidate where it is accurate enough
+    bool autoTune;              // time the candidates (false: the crossover constants)
+};
+
+// Plan: the kernel, IIR coefficients and work buffers of the Gaussian filter, built once for
+// the image shape, channel count and (kernel size, sigma); executing it allocates nothing
+// channels = 3 for interleaved images, 1 for planes (one plan per thread: it owns its scratch)
+struct GaussianFilterPlan {
+    int width;
+    int height;
+    int channels;
+    int kernelSize;
+    double sigma;
+    GaussianVariant variant;                   // the implementation this plan runs (never AUTO)
+    std::vector<double> kernel;                // normalized kernel (direct and FFT paths)
+    FixedPointKernel fixedKernel;              // Q-format weights (fixed-point path)
+    std::vector<const unsigned char*> rowPointers; // input rows under the kernel (fixed-point path)
+    RecursiveGaussianCoefficients coefficients; // recursive path
+    std::vector<float> scratch;                // image-sized working copy (recursive path)
+    std::vector<float> columnState;            // three rows of column-pass state (recursive path)
+    FFTConvolutionPlan fftPlan;                // cached kernel spectrum and tiles, one channel at a time (FFT path)
+    std::vector<double> fftOutput;             // one channel of the result (FFT path)
+};
+
+// Helper function: Gaussian weight at a distance (normalized away with the kernel)
+inline double gaussianKernelWeight(double x, double sigma) {
+    return std::exp(-(x * x) / (2 * sigma * sigma)) / (std::sqrt(2 * M_PI) * sigma);
+}
+
+inline GaussianVariant chooseGaussianVariant(int width, int height, int channels, int kernelSize, double sigma,
+                                             const GaussianFilterSettings& settings);
+
+// Function: build a Gaussian filter plan (GAUSSIAN_AUTO: recursive for large sigmas, otherwise
+// the auto-tuned or crossover choice)
+inline GaussianFilterPlan createGaussianFilterPlan(int width, int height, int channels, int kernelSize, double sigma,
+                                                   const GaussianFilterSettings& settings,
+                                                   GaussianVariant variant = GAUSSIAN_AUTO) {
+    GaussianFilterPlan plan;
+    plan.width = width;
+    plan.height = height;
+    plan.channels = channels;
+    plan.kernelSize = kernelSize;
+    plan.sigma = sigma;
+    plan.variant = (variant == GAUSSIAN_AUTO)
+        ? chooseGaussianVariant(width, height, channels, kernelSize, sigma, settings) : variant;
+
+    if (plan.variant == GAUSSIAN_RECURSIVE) {
+        plan.coefficients = computeRecursiveGaussianCoefficients(sigma);
+        plan.scratch.resize(static_cast<size_t>(width) * height * channels);
+        plan.columnState.resize(3 * static_cast<size_t>(width) * channels);
+        return plan;
+    }
+
+    int edge = kernelSize / 2;
+    plan.kernel.resize(kernelSize * kernelSize);
+    double sum = 0.0;
+
+    // generate Gaussian kernel
+    for (int i = -edge; i <= edge; ++i) {
+        for (int j = -edge; j <= edge; ++j) {
+            int index = (i + edge) * kernelSize + (j + edge);
+            plan.kernel[index] = gaussianKernelWeight(std::sqrt(i * i + j * j), sigma);
+            sum += plan.kernel[index];
+        }
+    }
+
+    // normalize the kernel
+    for (double &value : plan.kernel) {
+        value /= sum;
+    }
+
+    if (plan.variant == GAUSSIAN_FIXED_POINT) {
+        plan.fixedKernel = createFixedPointKernel(plan.kernel, kernelSize, kernelSize);
+        plan.rowPointers.resize(kernelSize);
+    }
+    if (plan.variant == GAUSSIAN_FFT) {
+        // tile size tuned only for the plans actually used, not the candidates being timed
+        int tileSize = (settings.autoTune && variant == GAUSSIAN_AUTO)
+            ? tunedFFTTileSize(plan.kernel, kernelSize, kernelSize, width, height) : 0;
+        plan.fftPlan = createFFTConvolutionPlan(plan.kernel, kernelSize, kernelSize, width, height, tileSize);
+        plan.fftOutput.resize(static_cast<size_t>(width) * height);
+    }
+
+    return plan;
+}
+
+// Function: run a Gaussian filter plan; output is resized to the input size (no allocation
+// once it has been used with the same shape)
+inline void executeGaussianFilterPlan(GaussianFilterPlan& plan,
+                                      const std::vector<unsigned char>& image,
+                                      std::vector<unsigned char>& output) {
+    const int width = plan.width;
+    const int height = plan.height;
+    const int channels = plan.channels;
+    output.resize(image.size());
+
+    if (plan.variant == GAUSSIAN_RECURSIVE) {
+        recursiveGaussianImage(plan.coefficients, image.data(), width, height, channels,
+                               plan.scratch.data(), plan.columnState.data(), output.data());
+        return;
+    }
+
+    const int kernelSize = plan.kernelSize;
+    const int edge = kernelSize / 2;
+    const double* kernel = plan.kernel.data();
+    auto clampByte = [](int value) { return static_cast<unsigned char>(std::max(0, std::min(value, 255))); };
+
+    if (plan.variant == GAUSSIAN_FIXED_POINT) {
+        // interleaved rows: the taps of one channel are `channels` bytes apart, so the interior
+        // columns of all channels run as one SIMD row; the border columns clamp in scalar code
+        const FixedPointKernel& fixed = plan.fixedKernel;
+        const int rowBytes = width * channels;
+        const int interiorEnd = std::max(edge, width - edge);
+        for (int y = 0; y < height; ++y) {
+            for (int r = 0; r < kernelSize; ++r) {
+                plan.rowPointers[r] = &image[std::min(std::max(y - edge + r, 0), height - 1) * rowBytes];
+            }
+            convolveFixedPointRow(fixed, plan.rowPointers.data(), channels, (interiorEnd - edge) * channels,
+                                  &output[y * rowBytes + edge * channels]);
+
+            for (int x = 0; x < width; ++x) {
+                if (x >= edge && x < interiorEnd) {
+                    x = interiorEnd - 1;
+                    continue;
+                }
+                for (int channel = 0; channel < channels; ++channel) {
+                    int sum = 0;
+                    for (int r = 0; r < kernelSize; ++r) {
+                        for (int c = 0; c < kernelSize; ++c) {
+                            int nx = std::min(std::max(x - edge + c, 0), width - 1);
+                            sum += plan.rowPointers[r][nx * channels + channel] * fixed.weights[r * kernelSize + c];
+                        }
+                    }
+                    output[y * rowBytes + x * channels + channel] = clampByte(sum >> fixed.fractionBits);
+                }
+            }
+        }
+        return;
+    }
+
+    if (plan.variant == GAUSSIAN_FFT) {
+        // the FFT tiles replicate the edges, like the clamped direct loop
+        for (int channel = 0; channel < channels; ++channel) {
+            executeFFTConvolution(plan.fftPlan, image.data() + channel, width, height, channels, plan.fftOutput.data());
+            for (int i = 0; i < width * height; ++i) {
+                output[i * channels + channel] = clampByte(static_cast<int>(plan.fftOutput[i]));
+            }
+        }
+        return;
+    }
+
+    // apply Gaussian filter: interior through the dispatched row kernel, clamped border below
+    const CpuKernels& kernels = cpuKernels();
+    const int rowBytes = width * channels;
+    const int interiorEnd = std::max(edge, width - edge);
+    for (int y = 0; y < height; ++y) {
+        const bool interiorRow = (y >= edge && y < height - edge);
+        if (interiorRow && interiorEnd > edge) {
+            kernels.convolveRow(&image[(y - edge) * rowBytes], rowBytes, channels, (interiorEnd - edge) * channels,
+                                kernel, kernelSize, &output[y * rowBytes + edge * channels]);
+        }
+        for (int x = 0; x < width; ++x) {
+            if (interiorRow && x >= edge && x < interiorEnd) {
+                x = interiorEnd - 1;
+                continue;
+            }
+            for (int channel = 0; channel < channels; ++channel) {
+                double weightedSum = 0.0;
+
+                for (int dy = -edge; dy <= edge; ++dy) {
+                    const unsigned char* row = &image[std::min(std::max(y + dy, 0), height - 1) * width * channels];
+                    for (int dx = -edge; dx <= edge; ++dx) {
+                        int nx = std::min(std::max(x + dx, 0), width - 1);
+                        weightedSum += row[nx * channels + channel] * kernel[(dy + edge) * kernelSize + (dx + edge)];
+                    }
+                }
+
+                output[channels * (y * width + x) + channel] = clampByte(static_cast<int>(weightedSum));
+            }
+        }
+    }
+}
+
+// Function: pick the Gaussian implementation for a plan. Large sigmas take the recursive filter
+// (an accuracy choice, see settings.recursiveSigma). Otherwise the auto-tuner times the
+// candidates near the measured crossovers on a noise image of the real shape (sigma does not
+// change the cost, so it is not part of the key).
+inline GaussianVariant chooseGaussianVariant(int width, int height, int channels, int kernelSize, double sigma,
+                                             const GaussianFilterSettings& settings) {
+    if (sigma >= settings.recursiveSigma) {
+        return GAUSSIAN_RECURSIVE;
+    }
+    const int taps = kernelSize * kernelSize;
+    const bool fixedPoint = settings.fixedPoint && useFixedPointConvolution(kernelSize, kernelSize);
+    if (!settings.autoTune) {
+        if (fixedPoint) {
+            return GAUSSIAN_FIXED_POINT;
+        }
+        return useFFTConvolution(kernelSize, kernelSize) ? GAUSSIAN_FFT : GAUSSIAN_DIRECT;
+    }
+
+    // far from the crossover the slow side is not worth timing
+    std::vector<std::string> candidates;
+    if (taps <= 4 * FFT_CONVOLUTION_MIN_TAPS) {
+        candidates.push_back("direct");
+    }
+    if (fixedPoint) {
+        candidates.push_back("fixed-point");
+    }
+    if (4 * taps >= FFT_CONVOLUTION_MIN_TAPS) {
+        candidates.push_back("fft");
+    }
+
+    std::vector<unsigned char> image = benchmarkImage(static_cast<size_t>(width) * height * channels);
+    std::vector<unsigned char> output(image.size());
+    std::string shape = shapeKey(width, height, channels) + " k" + std::to_string(kernelSize);
+    std::string best = autoTune("gaussian", shape, candidates, [&](const std::string& candidate) {
+        GaussianVariant forced = (candidate == "fft") ? GAUSSIAN_FFT
+                               : (candidate == "fixed-point") ? GAUSSIAN_FIXED_POINT : GAUSSIAN_DIRECT;
+        GaussianFilterPlan plan = createGaussianFilterPlan(width, height, channels, kernelSize, sigma, settings, forced);
+        executeGaussianFilterPlan(plan, image, output);
+    });
+    return (best == "fft") ? GAUSSIAN_FFT : (best == "fixed-point") ? GAUSSIAN_FIXED_POINT : GAUSSIAN_DIRECT;
+}
+
+#endif // GAUSSIAN_FILTER_H
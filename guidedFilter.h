@@ -0,0 +1,276 @@
+// O(1) guided filter (He, Sun and Tang)
+//
+// Edge-preserving smoothing built only from box means, so the cost per pixel does not depend
+// on the radius. Per window the output is a linear function of the guide:
+//   q = mean(a) * I + mean(b),   a = cov(I, p) / (var(I) + eps),   b = mean(p) - a * mean(I)
+// A gray guide (1 channel) gives the self-guided filter when guide == input; a BGR guide
+// (3 channels) uses the 3 x 3 covariance of the guide instead of var(I), so edges of any
+// channel are kept in all of them. eps plays the role of the bilateral range sigma squared
+// (in 8-bit units): edges with a contrast well above sqrt(eps) are preserved.
+//
+// Box means are running sums (double accumulators, float planes): a horizontal pass per row,
+// then a vertical pass that slides one column accumulator over the rows. Windows are clipped
+// at the borders and normalized by their actual size.
+
+#ifndef GUIDED_FILTER_H
+#define GUIDED_FILTER_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Plan: the box-window normalization and the float work planes of the guided filter, built once
+// for the image shape, guide / input channel counts (interleaved) and (radius, eps); executing
+// it allocates nothing (one plan per thread: it owns its scratch)
+struct GuidedFilterPlan {
+    int width;
+    int height;
+    int guideChannels;                  // 1 (gray) or 3 (BGR)
+    int inputChannels;                  // channels of the filtered image, each guided by the whole guide
+    int radius;
+    double eps;
+    std::vector<float> inverseCountX;   // 1 / clipped window width at each column
+    std::vector<float> inverseCountY;   // 1 / clipped window height at each row
+    std::vector<double> columnSums;     // vertical pass accumulator, one per column
+    std::vector<float> horizontal;      // horizontal pass output
+    std::vector<float> product;         // pointwise products before their box mean
+    std::array<std::vector<float>, 3> guide;
+    std::array<std::vector<float>, 3> meanGuide;
+    std::array<std::vector<float>, 6> inverseCovariance; // (Sigma + eps)^-1: bb bg br gg gr rr (gray: 1 / (var + eps))
+    std::vector<float> input;
+    std::vector<float> meanInput;
+    std::array<std::vector<float>, 3> cross; // mean(I p), then mean(a)
+    std::array<std::vector<float>, 3> coefficientA;
+    std::vector<float> coefficientB;
+};
+
+// Function: build a guided filter plan
+inline GuidedFilterPlan createGuidedFilterPlan(int width, int height, int guideChannels, int inputChannels,
+                                               int radius, double eps) {
+    GuidedFilterPlan plan;
+    plan.width = width;
+    plan.height = height;
+    plan.guideChannels = guideChannels;
+    plan.inputChannels = inputChannels;
+    plan.radius = radius;
+    plan.eps = eps;
+
+    plan.inverseCountX.resize(width);
+    for (int x = 0; x < width; ++x) {
+        plan.inverseCountX[x] = 1.0f / (std::min(x + radius, width - 1) - std::max(x - radius, 0) + 1);
+    }
+    plan.inverseCountY.resize(height);
+    for (int y = 0; y < height; ++y) {
+        plan.inverseCountY[y] = 1.0f / (std::min(y + radius, height - 1) - std::max(y - radius, 0) + 1);
+    }
+
+    const size_t pixels = static_cast<size_t>(width) * height;
+    plan.columnSums.resize(width);
+    plan.horizontal.resize(pixels);
+    plan.product.resize(pixels);
+    for (int g = 0; g < guideChannels; ++g) {
+        plan.guide[g].resize(pixels);
+        plan.meanGuide[g].resize(pixels);
+        plan.cross[g].resize(pixels);
+        plan.coefficientA[g].resize(pixels);
+    }
+    for (int k = 0; k < (guideChannels == 1 ? 1 : 6); ++k) {
+        plan.inverseCovariance[k].resize(pixels);
+    }
+    plan.input.resize(pixels);
+    plan.meanInput.resize(pixels);
+    plan.coefficientB.resize(pixels);
+    return plan;
+}
+
+// Helper function: box mean of a float plane over the plan's clipped (2r+1)^2 windows
+// (output may alias source: the horizontal pass goes through plan.horizontal)
+inline void guidedBoxMean(GuidedFilterPlan& plan, const float* source, float* output) {
+    const int width = plan.width;
+    const int height = plan.height;
+    const int r = plan.radius;
+
+    // horizontal running sums
+    for (int y = 0; y < height; ++y) {
+        const float* row = source + static_cast<size_t>(y) * width;
+        float* sums = &plan.horizontal[static_cast<size_t>(y) * width];
+        double sum = 0.0;
+        for (int x = 0; x <= std::min(r, width - 1); ++x) {
+            sum += row[x];
+        }
+        for (int x = 0; x < width; ++x) {
+            sums[x] = static_cast<float>(sum);
+            if (x + r + 1 < width) {
+                sum += row[x + r + 1];
+            }
+            if (x - r >= 0) {
+                sum -= row[x - r];
+            }
+        }
+    }
+
+    // vertical: slide the column accumulators down (the inner loops run along a row)
+    double* columns = plan.columnSums.data();
+    std::fill(columns, columns + width, 0.0);
+    for (int y = 0; y <= std::min(r, height - 1); ++y) {
+        const float* sums = &plan.horizontal[static_cast<size_t>(y) * width];
+        for (int x = 0; x < width; ++x) {
+            columns[x] += sums[x];
+        }
+    }
+    for (int y = 0; y < height; ++y) {
+        float* out = output + static_cast<size_t>(y) * width;
+        const float inverseY = plan.inverseCountY[y];
+        for (int x = 0; x < width; ++x) {
+            out[x] = static_cast<float>(columns[x]) * plan.inverseCountX[x] * inverseY;
+        }
+        if (y + r + 1 < height) {
+            const float* entering = &plan.horizontal[static_cast<size_t>(y + r + 1) * width];
+            for (int x = 0; x < width; ++x) {
+                columns[x] += entering[x];
+            }
+        }
+        if (y - r >= 0) {
+            const float* leaving = &plan.horizontal[static_cast<size_t>(y - r) * width];
+            for (int x = 0; x < width; ++x) {
+                columns[x] -= leaving[x];
+            }
+        }
+    }
+}
+
+// Helper function: box mean of the product of two planes
+inline void guidedBoxMeanOfProduct(GuidedFilterPlan& plan, const float* a, const float* b, float* output) {
+    const size_t pixels = plan.product.size();
+    float* product = plan.product.data();
+    for (size_t i = 0; i < pixels; ++i) {
+        product[i] = a[i] * b[i];
+    }
+    guidedBoxMean(plan, product, output);
+}
+
+// Function: run a guided filter plan. guide is width x height x guideChannels, input and
+// output are width x height x inputChannels (interleaved); output may alias either (both are
+// read into the plan's planes first). Pass the same image as guide and input for self-guided
+// smoothing.
+inline void executeGuidedFilterPlan(GuidedFilterPlan& plan,
+                                    const unsigned char* guide,
+                                    const unsigned char* input,
+                                    unsigned char* output) {
+    const size_t pixels = plan.product.size();
+    const int G = plan.guideChannels;
+    const int C = plan.inputChannels;
+    const float eps = static_cast<float>(plan.eps);
+
+    // guide statistics, shared by every input channel
+    for (int g = 0; g < G; ++g) {
+        float* plane = plan.guide[g].data();
+        for (size_t i = 0; i < pixels; ++i) {
+            plane[i] = guide[i * G + g];
+        }
+        guidedBoxMean(plan, plane, plan.meanGuide[g].data());
+    }
+    if (G == 1) {
+        float* inverseVariance = plan.inverseCovariance[0].data();
+        const float* mean = plan.meanGuide[0].data();
+        guidedBoxMeanOfProduct(plan, plan.guide[0].data(), plan.guide[0].data(), inverseVariance);
+        for (size_t i = 0; i < pixels; ++i) {
+            inverseVariance[i] = 1.0f / (inverseVariance[i] - mean[i] * mean[i] + eps);
+        }
+    } else {
+        static const int pairs[6][2] = {{0, 0}, {0, 1}, {0, 2}, {1, 1}, {1, 2}, {2, 2}};
+        for (int k = 0; k < 6; ++k) {
+            guidedBoxMeanOfProduct(plan, plan.guide[pairs[k][0]].data(), plan.guide[pairs[k][1]].data(),
+                                   plan.inverseCovariance[k].data());
+        }
+        float* s[6];
+        for (int k = 0; k < 6; ++k) {
+            s[k] = plan.inverseCovariance[k].data();
+        }
+        const float* m0 = plan.meanGuide[0].data();
+        const float* m1 = plan.meanGuide[1].data();
+        const float* m2 = plan.meanGuide[2].data();
+        for (size_t i = 0; i < pixels; ++i) {
+            // Sigma + eps * identity, inverted by cofactors (symmetric)
+            float a00 = s[0][i] - m0[i] * m0[i] + eps;
+            float a01 = s[1][i] - m0[i] * m1[i];
+            float a02 = s[2][i] - m0[i] * m2[i];
+            float a11 = s[3][i] - m1[i] * m1[i] + eps;
+            float a12 = s[4][i] - m1[i] * m2[i];
+            float a22 = s[5][i] - m2[i] * m2[i] + eps;
+            float c00 = a11 * a22 - a12 * a12;
+            float c01 = a02 * a12 - a01 * a22;
+            float c02 = a01 * a12 - a02 * a11;
+            float c11 = a00 * a22 - a02 * a02;
+            float c12 = a01 * a02 - a00 * a12;
+            float c22 = a00 * a11 - a01 * a01;
+            float inverseDeterminant = 1.0f / (a00 * c00 + a01 * c01 + a02 * c02);
+            s[0][i] = c00 * inverseDeterminant;
+            s[1][i] = c01 * inverseDeterminant;
+            s[2][i] = c02 * inverseDeterminant;
+            s[3][i] = c11 * inverseDeterminant;
+            s[4][i] = c12 * inverseDeterminant;
+            s[5][i] = c22 * inverseDeterminant;
+        }
+    }
+
+    for (int c = 0; c < C; ++c) {
+        float* p = plan.input.data();
+        for (size_t i = 0; i < pixels; ++i) {
+            p[i] = input[i * C + c];
+        }
+        guidedBoxMean(plan, p, plan.meanInput.data());
+        for (int g = 0; g < G; ++g) {
+            guidedBoxMeanOfProduct(plan, plan.guide[g].data(), p, plan.cross[g].data());
+        }
+
+        // per-window coefficients
+        const float* meanP = plan.meanInput.data();
+        float* b = plan.coefficientB.data();
+        if (G == 1) {
+            const float* meanI = plan.meanGuide[0].data();
+            const float* inverseVariance = plan.inverseCovariance[0].data();
+            const float* cross = plan.cross[0].data();
+            float* a = plan.coefficientA[0].data();
+            for (size_t i = 0; i < pixels; ++i) {
+                a[i] = (cross[i] - meanI[i] * meanP[i]) * inverseVariance[i];
+                b[i] = meanP[i] - a[i] * meanI[i];
+            }
+        } else {
+            const float* s[6];
+            for (int k = 0; k < 6; ++k) {
+                s[k] = plan.inverseCovariance[k].data();
+            }
+            for (size_t i = 0; i < pixels; ++i) {
+                float cov0 = plan.cross[0][i] - plan.meanGuide[0][i] * meanP[i];
+                float cov1 = plan.cross[1][i] - plan.meanGuide[1][i] * meanP[i];
+                float cov2 = plan.cross[2][i] - plan.meanGuide[2][i] * meanP[i];
+                float a0 = s[0][i] * cov0 + s[1][i] * cov1 + s[2][i] * cov2;
+                float a1 = s[1][i] * cov0 + s[3][i] * cov1 + s[4][i] * cov2;
+                float a2 = s[2][i] * cov0 + s[4][i] * cov1 + s[5][i] * cov2;
+                plan.coefficientA[0][i] = a0;
+                plan.coefficientA[1][i] = a1;
+                plan.coefficientA[2][i] = a2;
+                b[i] = meanP[i] - a0 * plan.meanGuide[0][i] - a1 * plan.meanGuide[1][i] - a2 * plan.meanGuide[2][i];
+            }
+        }
+
+        // average the coefficients of every window covering a pixel, then apply them
+        for (int g = 0; g < G; ++g) {
+            guidedBoxMean(plan, plan.coefficientA[g].data(), plan.cross[g].data());
+        }
+        guidedBoxMean(plan, b, plan.meanInput.data());
+        const float* meanB = plan.meanInput.data();
+        for (size_t i = 0; i < pixels; ++i) {
+            float q = meanB[i];
+            for (int g = 0; g < G; ++g) {
+                q += plan.cross[g][i] * plan.guide[g][i];
+            }
+            int value = static_cast<int>(q + 0.5f);
+            output[i * C + c] = static_cast<unsigned char>(std::min(std::max(value, 0), 255));
+        }
+    }
+}
+
+#endif // GUIDED_FILTER_H
@@ -0,0 +1,249 @@
+// Image diff engine for 8-bit raw images
+//
+// One pass over the two images, split across threads by rows: absolute differences are
+// taken 16 bytes at a time (NEON / SSE2) and fed into per-channel histograms, from which
+// the max / mean error, MSE and PSNR follow. The same pass counts the pixels where any
+// channel differs by more than the threshold, and can write a difference map (the absolute
+// difference per channel, same layout as the inputs) and list the first N such pixels
+// into a buffered report.
+
+#ifndef IMAGE_DIFF_H
+#define IMAGE_DIFF_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+struct ImageDiffOptions {
+    int threshold = 10;                     // a pixel is significant when any channel differs by more
+    bool diffMap = false;                   // fill ImageDiffReport::diffMap
+    int maxListed = 0;                      // list at most this many significant pixels (0: none)
+};
+
+struct ImageDiffReport {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<std::array<uint64_t, 256> > histograms; // |difference| counts, per channel
+    std::vector<int> maxError;              // per channel
+    std::vector<double> meanError;          // per channel
+    std::vector<double> psnr;               // per channel, dB
+    double overallPsnr = 0.0;               // over all channels, dB (infinity when identical)
+    size_t significantPixels = 0;           // pixels over the threshold in any channel
+    std::vector<unsigned char> diffMap;     // |difference| per channel (options.diffMap)
+    std::string listing;                    // first options.maxListed significant pixels
+};
+
+// Helper function: absolute difference of count bytes
+inline void absoluteDifference(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16) {
+        vst1q_u8(out + i, vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= count; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), d);
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = static_cast<unsigned char>(a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]);
+    }
+}
+
+// Helper function: whether any byte of the block is above the threshold (SIMD early-out for
+// the per-pixel significance check)
+inline bool anyAbove(const unsigned char* diff, size_t count, int threshold) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    uint8x16_t limit = vdupq_n_u8(static_cast<uint8_t>(threshold));
+    for (; i + 16 <= count; i += 16) {
+        if (vmaxvq_u8(vcgtq_u8(vld1q_u8(diff + i), limit)) != 0) {
+            return true;
+        }
+    }
+#elif defined(__SSE2__)
+    __m128i limit = _mm_set1_epi8(static_cast<char>(threshold));
+    for (; i + 16 <= count; i += 16) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(diff + i));
+        // d > threshold  <=>  max(d, threshold) != threshold
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(d, limit), limit)) != 0xFFFF) {
+            return true;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        if (diff[i] > threshold) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Helper function: one listing line (channels named B, G, R for 3-channel images)
+inline void appendListing(std::ostringstream& listing, size_t pixel, const unsigned char* diff, int channels) {
+    listing << "Significant difference at pixel " << pixel << ", with ";
+    for (int c = 0; c < channels; ++c) {
+        if (c > 0) {
+            listing << ", ";
+        }
+        if (channels == 3) {
+            listing << "BGR"[c] << ":";
+        } else {
+            listing << "C" << c << ":";
+        }
+        listing << static_cast<int>(diff[c]);
+    }
+    listing << " intensity differences.\n";
+}
+
+// Function: compare two interleaved 8-bit images of the same shape
+inline ImageDiffReport diffImages(const unsigned char* image1,
+                                  const unsigned char* image2,
+                                  int width,
+                                  int height,
+                                  int channels,
+                                  const ImageDiffOptions& options = ImageDiffOptions()) {
+    ImageDiffReport report;
+    report.width = width;
+    report.height = height;
+    report.channels = channels;
+    const size_t rowBytes = static_cast<size_t>(width) * channels;
+    if (options.diffMap) {
+        report.diffMap.resize(rowBytes * height);
+    }
+
+    // per-thread partial results over a band of rows
+    struct Partial {
+        std::vector<std::array<uint64_t, 256> > histograms;
+        size_t significant = 0;
+        int listed = 0;
+        std::ostringstream listing;
+    };
+    int numThreads = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()), height));
+    std::vector<Partial> partials(numThreads);
+    int rowsPerThread = (height + numThreads - 1) / numThreads;
+
+    auto job = [&](int t) {
+        Partial& partial = partials[t];
+        partial.histograms.assign(channels, std::array<uint64_t, 256>());
+        std::vector<unsigned char> rowBuffer(options.diffMap ? 0 : rowBytes);
+        int rowEnd = std::min(height, (t + 1) * rowsPerThread);
+        for (int y = t * rowsPerThread; y < rowEnd; ++y) {
+            size_t offset = static_cast<size_t>(y) * rowBytes;
+            unsigned char* diff = options.diffMap ? &report.diffMap[offset] : rowBuffer.data();
+            absoluteDifference(image1 + offset, image2 + offset, diff, rowBytes);
+
+            for (size_t i = 0; i < rowBytes; i += channels) {
+                for (int c = 0; c < channels; ++c) {
+                    partial.histograms[c][diff[i + c]]++;
+                }
+            }
+
+            // significance per pixel only on rows that have any
+            if (!anyAbove(diff, rowBytes, options.threshold)) {
+                continue;
+            }
+            for (int x = 0; x < width; ++x) {
+                const unsigned char* pixel = diff + static_cast<size_t>(x) * channels;
+                if (!anyAbove(pixel, channels, options.threshold)) {
+                    continue;
+                }
+                partial.significant++;
+                if (partial.listed < options.maxListed) {
+                    appendListing(partial.listing, static_cast<size_t>(y) * width + x, pixel, channels);
+                    partial.listed++;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < numThreads; ++t) {
+        workers.emplace_back(job, t);
+    }
+    job(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // merge in row order, so the listing holds the first significant pixels
+    report.histograms.assign(channels, std::array<uint64_t, 256>());
+    int listed = 0;
+    std::string listing;
+    for (Partial& partial : partials) {
+        for (int c = 0; c < channels; ++c) {
+            for (int v = 0; v < 256; ++v) {
+                report.histograms[c][v] += partial.histograms[c][v];
+            }
+        }
+        report.significantPixels += partial.significant;
+        if (listed < options.maxListed) {
+            std::string lines = partial.listing.str();
+            size_t cut = 0;
+            while (listed < options.maxListed && cut < lines.size()) {
+                cut = lines.find('\n', cut) + 1;
+                listed++;
+            }
+            listing.append(lines, 0, cut);
+        }
+    }
+    report.listing = listing;
+
+    // statistics from the histograms
+    const double pixels = static_cast<double>(width) * height;
+    double totalSquared = 0.0;
+    report.maxError.assign(channels, 0);
+    report.meanError.assign(channels, 0.0);
+    report.psnr.assign(channels, std::numeric_limits<double>::infinity());
+    for (int c = 0; c < channels; ++c) {
+        double sum = 0.0;
+        double squared = 0.0;
+        for (int v = 0; v < 256; ++v) {
+            uint64_t n = report.histograms[c][v];
+            if (n > 0) {
+                report.maxError[c] = v;
+            }
+            sum += static_cast<double>(n) * v;
+            squared += static_cast<double>(n) * v * v;
+        }
+        report.meanError[c] = sum / pixels;
+        if (squared > 0.0) {
+            report.psnr[c] = 10.0 * std::log10(255.0 * 255.0 / (squared / pixels));
+        }
+        totalSquared += squared;
+    }
+    report.overallPsnr = (totalSquared > 0.0)
+        ? 10.0 * std::log10(255.0 * 255.0 / (totalSquared / (pixels * channels)))
+        : std::numeric_limits<double>::infinity();
+    return report;
+}
+
+// Function: print the summary of a diff report (and its listing, if any)
+inline void printDiffReport(const ImageDiffReport& report, std::ostream& out) {
+    out << report.listing;
+    for (int c = 0; c < report.channels; ++c) {
+        out << "Channel " << c << ": max error " << report.maxError[c]
+            << ", mean error " << report.meanError[c]
+            << ", PSNR " << report.psnr[c] << " dB" << "\n";
+    }
+    out << "PSNR: " << report.overallPsnr << " dB" << "\n";
+}
+
+#endif // IMAGE_DIFF_H
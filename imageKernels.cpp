@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "imageKernels.h"
+
+// the header-only kernels are inline functions, which the linker would export as weak
+// symbols next to the ik_* ABI: keep them (and everything below but the ABI) internal
+#if defined(__GNUC__)
+#pragma GCC visibility push(hidden)
+#endif
+#include "cpuDispatch.h"
+#include "guidedFilter.h"
+#if defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
+// Shared library exporting the image kernels with a plain C ABI (imageKernels.h), so the
+// Python tooling can run them on numpy arrays in memory instead of through .raw files:
+//   g++ -std=c++17 -O2 -shared -fPIC imageKernels.cpp -o libimagekernels.so
+//
+// The stencils copy the input once into a packed buffer with replicated edges; every output
+// then has its whole window inside that buffer, so each row is one call of the dispatched
+// row kernel (cpuDispatch.h) and the output may alias the input.
+//
+// Scratch buffers and the weights / guided filter plan of the last parameters are cached per
+// calling thread, so a long-lived thread (a filterServer worker, a Python loop) neither
+// rebuilds nor reallocates them on repeated calls with the same shape and parameters.
+
+namespace {
+
+// Helper function: check a caller buffer description
+bool validImage(const uint8_t* pixels, int stride, int width, int height, int channels) {
+    return pixels != nullptr && width > 0 && height > 0 && channels > 0 && stride >= width * channels;
+}
+
+// Helper function: copy a strided image into a packed buffer with `edge` replicated pixels on
+// every side ((width + 2 edge) x (height + 2 edge) x channels); padded keeps its capacity
+void padImage(const uint8_t* src, int srcStride, int width, int height, int channels, int edge,
+              std::vector<unsigned char>& padded) {
+    const int paddedWidth = width + 2 * edge;
+    const size_t rowBytes = static_cast<size_t>(paddedWidth) * channels;
+    padded.resize(rowBytes * (height + 2 * edge));
+
+    for (int y = 0; y < height + 2 * edge; ++y) {
+        const uint8_t* row = src + static_cast<size_t>(std::min(std::max(y - edge, 0), height - 1)) * srcStride;
+        unsigned char* out = &padded[y * rowBytes];
+        for (int x = 0; x < edge; ++x) {
+            std::memcpy(out + x * channels, row, channels);
+            std::memcpy(out + (edge + width + x) * channels, row + (width - 1) * channels, channels);
+        }
+        std::memcpy(out + edge * channels, row, static_cast<size_t>(width) * channels);
+    }
+}
+
+// Helper function: Gaussian function (as in p2d / p3)
+double gaussian(double x, double sigma) {
+    return std::exp(-(x * x) / (2 * sigma * sigma)) / (std::sqrt(2 * M_PI) * sigma);
+}
+
+// Helper function: Gaussian function for the bilateral filter (as in p3)
+double gaussianBF(double x, double sigma) {
+    return std::exp(-(x * x) / (2 * sigma * sigma));
+}
+
+// Per-thread scratch and the plans of the most recent parameters
+struct KernelCache {
+    std::vector<unsigned char> padded;
+    std::vector<unsigned char> paddedGuide;
+    std::vector<unsigned char> neighbors;
+    std::vector<int> blue, green, red;
+
+    int gaussianSize = 0;
+    double gaussianSigma = 0.0;
+    std::vector<double> gaussianKernel;
+
+    int bilateralSize = 0;
+    double bilateralSigmaColor = 0.0;
+    double bilateralSigmaSpace = 0.0;
+    std::vector<double> spaceWeights;
+    double rangeWeights[256];
+
+    bool hasGuidedPlan = false;
+    GuidedFilterPlan guidedPlan;
+};
+
+// Helper function: the calling thread's cache
+KernelCache& kernelCache() {
+    static thread_local KernelCache cache;
+    return cache;
+}
+
+} // namespace
+
+extern "C" {
+
+const char* ik_cpu_level(void) {
+    return cpuLevelName(cpuKernels().level);
+}
+
+int ik_median(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+              int width, int height, int channels, int kernelSize) {
+    if (!validImage(src, srcStride, width, height, channels) || !validImage(dst, dstStride, width, height, channels) ||
+        kernelSize < 1 || kernelSize % 2 == 0) {
+        return IK_INVALID_ARGUMENT;
+    }
+    try {
+        const int edge = kernelSize / 2;
+        std::vector<unsigned char>& padded = kernelCache().padded;
+        padImage(src, srcStride, width, height, channels, edge, padded);
+        const size_t rowBytes = static_cast<size_t>(width + 2 * edge) * channels;
+        const int count = width * channels;
+
+        auto network = (kernelSize == 3) ? cpuKernels().median3x3Row
+                     : (kernelSize == 5) ? cpuKernels().median5x5Row : nullptr;
+        if (network != nullptr && channels <= CPU_DISPATCH_MAX_CHANNELS) {
+            for (int y = 0; y < height; ++y) {
+                network(&padded[y * rowBytes], rowBytes, channels, count, dst + static_cast<size_t>(y) * dstStride);
+            }
+            return IK_OK;
+        }
+
+        std::vector<unsigned char>& neighbors = kernelCache().neighbors;
+        neighbors.resize(kernelSize * kernelSize);
+        for (int y = 0; y < height; ++y) {
+            for (int i = 0; i < count; ++i) {
+                int n = 0;
+                for (int dy = 0; dy < kernelSize; ++dy) {
+                    const unsigned char* row = &padded[(y + dy) * rowBytes + i];
+                    for (int dx = 0; dx < kernelSize; ++dx) {
+                        neighbors[n++] = row[dx * channels];
+                    }
+                }
+                std::nth_element(neighbors.begin(), neighbors.begin() + n / 2, neighbors.end());
+                dst[static_cast<size_t>(y) * dstStride + i] = neighbors[n / 2];
+            }
+        }
+        return IK_OK;
+    } catch (const std::bad_alloc&) {
+        return IK_OUT_OF_MEMORY;
+    }
+}
+
+int ik_gaussian(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                int width, int height, int channels, int kernelSize, double sigma) {
+    if (!validImage(src, srcStride, width, height, channels) || !validImage(dst, dstStride, width, height, channels) ||
+        kernelSize < 1 || kernelSize % 2 == 0 || !(sigma > 0.0)) {
+        return IK_INVALID_ARGUMENT;
+    }
+    try {
+        const int edge = kernelSize / 2;
+        KernelCache& cache = kernelCache();
+        std::vector<double>& kernel = cache.gaussianKernel;
+        if (cache.gaussianSize != kernelSize || cache.gaussianSigma != sigma) {
+            kernel.resize(kernelSize * kernelSize);
+            double sum = 0.0;
+            for (int i = -edge; i <= edge; ++i) {
+                for (int j = -edge; j <= edge; ++j) {
+                    int index = (i + edge) * kernelSize + (j + edge);
+                    kernel[index] = gaussian(std::sqrt(i * i + j * j), sigma);
+                    sum += kernel[index];
+                }
+            }
+            for (double& value : kernel) {
+                value /= sum;
+            }
+            cache.gaussianSize = kernelSize;
+            cache.gaussianSigma = sigma;
+        }
+
+        std::vector<unsigned char>& padded = cache.padded;
+        padImage(src, srcStride, width, height, channels, edge, padded);
+        const size_t rowBytes = static_cast<size_t>(width + 2 * edge) * channels;
+        for (int y = 0; y < height; ++y) {
+            cpuKernels().convolveRow(&padded[y * rowBytes], rowBytes, channels, width * channels,
+                                     kernel.data(), kernelSize, dst + static_cast<size_t>(y) * dstStride);
+        }
+        return IK_OK;
+    } catch (const std::bad_alloc&) {
+        return IK_OUT_OF_MEMORY;
+    }
+}
+
+int ik_bilateral(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                 int width, int height, int channels, int kernelSize, double sigmaColor, double sigmaSpace) {
+    if (!validImage(src, srcStride, width, height, channels) || !validImage(dst, dstStride, width, height, channels) ||
+        kernelSize < 1 || kernelSize % 2 == 0 || !(sigmaColor > 0.0) || !(sigmaSpace > 0.0)) {
+        return IK_INVALID_ARGUMENT;
+    }
+    try {
+        const int edge = kernelSize / 2;
+        KernelCache& cache = kernelCache();
+        std::vector<double>& spaceWeights = cache.spaceWeights;
+        const double* rangeWeights = cache.rangeWeights;
+        if (cache.bilateralSize != kernelSize || cache.bilateralSigmaColor != sigmaColor ||
+            cache.bilateralSigmaSpace != sigmaSpace) {
+            spaceWeights.resize(kernelSize * kernelSize);
+            for (int i = -edge; i <= edge; ++i) {
+                for (int j = -edge; j <= edge; ++j) {
+                    spaceWeights[(i + edge) * kernelSize + (j + edge)] = gaussianBF(std::sqrt(i * i + j * j), sigmaSpace);
+                }
+            }
+            for (int d = 0; d < 256; ++d) {
+                cache.rangeWeights[d] = gaussianBF(d, sigmaColor);
+            }
+            cache.bilateralSize = kernelSize;
+            cache.bilateralSigmaColor = sigmaColor;
+            cache.bilateralSigmaSpace = sigmaSpace;
+        }
+
+        std::vector<unsigned char>& padded = cache.padded;
+        padImage(src, srcStride, width, height, channels, edge, padded);
+        const size_t rowBytes = static_cast<size_t>(width + 2 * edge) * channels;
+        for (int y = 0; y < height; ++y) {
+            cpuKernels().bilateralRow(&padded[y * rowBytes], rowBytes, channels, width * channels,
+                                      &padded[(y + edge) * rowBytes + edge * channels], spaceWeights.data(),
+                                      kernelSize, rangeWeights, dst + static_cast<size_t>(y) * dstStride);
+        }
+        return IK_OK;
+    } catch (const std::bad_alloc&) {
+        return IK_OUT_OF_MEMORY;
+    }
+}
+
+int ik_guided(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+              int width, int height, int channels,
+              const uint8_t* guide, int guideStride, int guideChannels, int radius, double eps) {
+    if (!validImage(src, srcStride, width, height, channels) || !validImage(dst, dstStride, width, height, channels) ||
+        radius < 1 || !(eps > 0.0)) {
+        return IK_INVALID_ARGUMENT;
+    }
+    if (guide == nullptr) {
+        guide = src;
+        guideStride = srcStride;
+        guideChannels = channels;
+    }
+    if ((guideChannels != 1 && guideChannels != 3) || !validImage(guide, guideStride, width, height, guideChannels)) {
+        return IK_INVALID_ARGUMENT;
+    }
+    try {
+        // the plan works on packed images
+        KernelCache& cache = kernelCache();
+        std::vector<unsigned char>& packedInput = cache.padded;
+        std::vector<unsigned char>& packedGuide = cache.paddedGuide;
+        padImage(src, srcStride, width, height, channels, 0, packedInput);
+        padImage(guide, guideStride, width, height, guideChannels, 0, packedGuide);
+        GuidedFilterPlan& plan = cache.guidedPlan;
+        if (!cache.hasGuidedPlan || plan.width != width || plan.height != height || plan.guideChannels != guideChannels ||
+            plan.inputChannels != channels || plan.radius != radius || plan.eps != eps) {
+            cache.hasGuidedPlan = false;
+            plan = createGuidedFilterPlan(width, height, guideChannels, channels, radius, eps);
+            cache.hasGuidedPlan = true;
+        }
+        executeGuidedFilterPlan(plan, packedGuide.data(), packedInput.data(), packedInput.data());
+
+        const size_t rowBytes = static_cast<size_t>(width) * channels;
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(dst + static_cast<size_t>(y) * dstStride, &packedInput[y * rowBytes], rowBytes);
+        }
+        return IK_OK;
+    } catch (const std::bad_alloc&) {
+        return IK_OUT_OF_MEMORY;
+    }
+}
+
+int ik_histogram(const uint8_t* src, int srcStride, int width, int height, int channels, int64_t* bins) {
+    if (!validImage(src, srcStride, width, height, channels) || bins == nullptr) {
+        return IK_INVALID_ARGUMENT;
+    }
+    if (channels == 1) {
+        // the dispatched kernel counts in int; split tall images so a bin cannot overflow
+        const int rowsPerCall = std::max(1, (1 << 30) / width);
+        for (int y = 0; y < height; y += rowsPerCall) {
+            int counts[256] = {0};
+            cpuKernels().histogram(src + static_cast<size_t>(y) * srcStride, width, std::min(rowsPerCall, height - y),
+                                   srcStride, counts);
+            for (int b = 0; b < 256; ++b) {
+                bins[b] += counts[b];
+            }
+        }
+        return IK_OK;
+    }
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = src + static_cast<size_t>(y) * srcStride;
+        for (int x = 0; x < width; ++x) {
+            for (int channel = 0; channel < channels; ++channel) {
+                bins[channel * 256 + row[x * channels + channel]]++;
+            }
+        }
+    }
+    return IK_OK;
+}
+
+int ik_apply_lut(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                 int width, int height, int channels, const uint8_t* lut) {
+    if (!validImage(src, srcStride, width, height, channels) || !validImage(dst, dstStride, width, height, channels) ||
+        lut == nullptr) {
+        return IK_INVALID_ARGUMENT;
+    }
+    try {
+        // the kernel does not allow its input and output to alias: in place goes through a row copy
+        const size_t rowBytes = static_cast<size_t>(width) * channels;
+        std::vector<unsigned char>& row = kernelCache().padded;
+        if (src == dst) {
+            row.resize(rowBytes);
+        }
+        for (int y = 0; y < height; ++y) {
+            const uint8_t* input = src + static_cast<size_t>(y) * srcStride;
+            if (src == dst) {
+                std::memcpy(row.data(), input, rowBytes);
+                input = row.data();
+            }
+            cpuKernels().applyLut(input, dst + static_cast<size_t>(y) * dstStride, rowBytes, lut);
+        }
+        return IK_OK;
+    } catch (const std::bad_alloc&) {
+        return IK_OUT_OF_MEMORY;
+    }
+}
+
+int ik_bgr_to_yuv(const uint8_t* src, int srcStride, int width, int height,
+                  uint8_t* y, int yStride, uint8_t* u, int uStride, uint8_t* v, int vStride) {
+    if (!validImage(src, srcStride, width, height, 3) || !validImage(y, yStride, width, height, 1) ||
+        !validImage(u, uStride, width, height, 1) || !validImage(v, vStride, width, height, 1)) {
+        return IK_INVALID_ARGUMENT;
+    }
+    try {
+        KernelCache& cache = kernelCache();
+        std::vector<int>& blue = cache.blue;
+        std::vector<int>& green = cache.green;
+        std::vector<int>& red = cache.red;
+        blue.resize(width);
+        green.resize(width);
+        red.resize(width);
+        for (int row = 0; row < height; ++row) {
+            const uint8_t* pixels = src + static_cast<size_t>(row) * srcStride;
+            for (int x = 0; x < width; ++x) {
+                blue[x] = pixels[3 * x];
+                green[x] = pixels[3 * x + 1];
+                red[x] = pixels[3 * x + 2];
+            }
+            cpuKernels().bgrToYuvRow(blue.data(), green.data(), red.data(), width,
+                                     y + static_cast<size_t>(row) * yStride, u + static_cast<size_t>(row) * uStride,
+                                     v + static_cast<size_t>(row) * vStride);
+        }
+        return IK_OK;
+    } catch (const std::bad_alloc&) {
+        return IK_OUT_OF_MEMORY;
+    }
+}
+
+int ik_mse(const uint8_t* a, int aStride, const uint8_t* b, int bStride,
+           int width, int height, int channels, double* mse) {
+    if (!validImage(a, aStride, width, height, channels) || !validImage(b, bStride, width, height, channels) ||
+        mse == nullptr) {
+        return IK_INVALID_ARGUMENT;
+    }
+    uint64_t total = 0;
+    for (int y = 0; y < height; ++y) {
+        total += cpuKernels().sumSquaredDifferences(a + static_cast<size_t>(y) * aStride,
+                                                    b + static_cast<size_t>(y) * bStride,
+                                                    static_cast<size_t>(width) * channels);
+    }
+    *mse = static_cast<double>(total) / (static_cast<double>(width) * height * channels);
+    return IK_OK;
+}
+
+} // extern "C"
@@ -0,0 +1,71 @@
+/* Plain C interface to the image kernels (libimagekernels.so, see imageKernels.cpp)
+ *
+ * Every image is a caller-owned 8-bit buffer described by (pixels, width, height, stride,
+ * channels): rows are `stride` bytes apart and hold width * channels interleaved values,
+ * so numpy views with padded rows (or a crop of a larger image) work as they are.
+ * Filters read the whole input before writing, so the output may be the input itself
+ * (in-place filtering). Functions return IK_OK or a negative error code; nothing throws
+ * across the interface.
+ *
+ * imageKernels.py wraps these for numpy arrays via ctypes.
+ */
+
+#ifndef IMAGE_KERNELS_H
+#define IMAGE_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    IK_OK = 0,
+    IK_INVALID_ARGUMENT = -1,   /* null pointer, empty image, stride too small, unsupported size / channels */
+    IK_OUT_OF_MEMORY = -2
+};
+
+/* SIMD level the kernels were bound to on this host ("baseline", "sse4", "avx2", "avx512") */
+const char* ik_cpu_level(void);
+
+/* median filter, edges replicated; 3 x 3 and 5 x 5 run on sorting networks, other odd sizes
+   on a selection per value */
+int ik_median(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+              int width, int height, int channels, int kernelSize);
+
+/* Gaussian filter (normalized kernelSize x kernelSize kernel), edges replicated; same results
+   as the direct Gaussian of p2d / p3 */
+int ik_gaussian(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                int width, int height, int channels, int kernelSize, double sigma);
+
+/* bilateral filter, edges replicated, range weights per channel; same results as p3 */
+int ik_bilateral(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                 int width, int height, int channels, int kernelSize, double sigmaColor, double sigmaSpace);
+
+/* guided filter (guidedFilter.h); guide = NULL filters the image guided by itself, otherwise
+   the guide is width x height with guideChannels (1 or 3) */
+int ik_guided(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+              int width, int height, int channels,
+              const uint8_t* guide, int guideStride, int guideChannels, int radius, double eps);
+
+/* per-channel histograms, added to bins[channel * 256 + value] */
+int ik_histogram(const uint8_t* src, int srcStride, int width, int height, int channels, int64_t* bins);
+
+/* dst = lut[src] for every value of every channel */
+int ik_apply_lut(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride,
+                 int width, int height, int channels, const uint8_t* lut);
+
+/* BGR to planar Y, U, V (BT.601 studio swing, as in p1c / p1d) */
+int ik_bgr_to_yuv(const uint8_t* src, int srcStride, int width, int height,
+                  uint8_t* y, int yStride, uint8_t* u, int uStride, uint8_t* v, int vStride);
+
+/* mean squared error over all values of two images of the same shape */
+int ik_mse(const uint8_t* a, int aStride, const uint8_t* b, int bStride,
+           int width, int height, int channels, double* mse);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IMAGE_KERNELS_H */
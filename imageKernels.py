@@ -0,0 +1,130 @@
+import ctypes
+import os
+import numpy as np
+
+# numpy front end of libimagekernels.so (imageKernels.h / imageKernels.cpp); build it with
+#   g++ -std=c++17 -O2 -shared -fPIC imageKernels.cpp -o libimagekernels.so
+#
+# Images are uint8 arrays of shape (height, width) or (height, width, channels) whose pixels are
+# contiguous within a row (any row stride, so crops of a larger array work). Nothing is copied
+# on the Python side: pass out=image to filter in place, e.g.
+#   import imageKernels as ik
+#   ik.median(image, 3, out=image)
+
+_lib = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libimagekernels.so'))
+
+_int = ctypes.c_int
+_ptr = ctypes.c_void_p
+_lib.ik_cpu_level.restype = ctypes.c_char_p
+_lib.ik_median.argtypes = [_ptr, _int, _ptr, _int, _int, _int, _int, _int]
+_lib.ik_gaussian.argtypes = [_ptr, _int, _ptr, _int, _int, _int, _int, _int, ctypes.c_double]
+_lib.ik_bilateral.argtypes = [_ptr, _int, _ptr, _int, _int, _int, _int, _int, ctypes.c_double, ctypes.c_double]
+_lib.ik_guided.argtypes = [_ptr, _int, _ptr, _int, _int, _int, _int, _ptr, _int, _int, _int, ctypes.c_double]
+_lib.ik_histogram.argtypes = [_ptr, _int, _int, _int, _int, _ptr]
+_lib.ik_apply_lut.argtypes = [_ptr, _int, _ptr, _int, _int, _int, _int, _ptr]
+_lib.ik_bgr_to_yuv.argtypes = [_ptr, _int, _int, _int, _ptr, _int, _ptr, _int, _ptr, _int]
+_lib.ik_mse.argtypes = [_ptr, _int, _ptr, _int, _int, _int, _int, ctypes.POINTER(ctypes.c_double)]
+
+def _describe(image):
+    # (pointer, row stride, width, height, channels) of a uint8 image with contiguous pixels
+    if image.dtype != np.uint8 or image.ndim not in (2, 3):
+        raise ValueError("Expected a uint8 array of shape (height, width) or (height, width, channels)")
+    height, width = image.shape[:2]
+    channels = image.shape[2] if image.ndim == 3 else 1
+    if image.strides[-1] != 1 or (image.ndim == 3 and image.strides[1] != channels) or image.strides[0] <= 0:
+        raise ValueError("Pixels must be contiguous within each row")
+    return image.ctypes.data, image.strides[0], width, height, channels
+
+def _output(image, out):
+    if out is None:
+        return np.empty_like(image)
+    if out.shape != image.shape:
+        raise ValueError("out must have the shape of the input")
+    if not out.flags.writeable:
+        raise ValueError("out is read-only")
+    return out
+
+def _check(status):
+    if status == -2:
+        raise MemoryError("image kernel ran out of memory")
+    if status != 0:
+        raise ValueError("invalid arguments for image kernel")
+
+def cpu_level():
+    return _lib.ik_cpu_level().decode()
+
+def median(image, kernel_size=3, out=None):
+    out = _output(image, out)
+    src, src_stride, width, height, channels = _describe(image)
+    dst, dst_stride = _describe(out)[:2]
+    _check(_lib.ik_median(src, src_stride, dst, dst_stride, width, height, channels, kernel_size))
+    return out
+
+def gaussian(image, kernel_size, sigma, out=None):
+    out = _output(image, out)
+    src, src_stride, width, height, channels = _describe(image)
+    dst, dst_stride = _describe(out)[:2]
+    _check(_lib.ik_gaussian(src, src_stride, dst, dst_stride, width, height, channels, kernel_size, sigma))
+    return out
+
+def bilateral(image, kernel_size, sigma_color, sigma_space, out=None):
+    out = _output(image, out)
+    src, src_stride, width, height, channels = _describe(image)
+    dst, dst_stride = _describe(out)[:2]
+    _check(_lib.ik_bilateral(src, src_stride, dst, dst_stride, width, height, channels,
+                             kernel_size, sigma_color, sigma_space))
+    return out
+
+def guided(image, radius, eps, guide=None, out=None):
+    out = _output(image, out)
+    src, src_stride, width, height, channels = _describe(image)
+    dst, dst_stride = _describe(out)[:2]
+    guide_ptr, guide_stride, guide_channels = None, 0, 0
+    if guide is not None:
+        if guide.shape[:2] != image.shape[:2]:
+            raise ValueError("guide must have the width and height of the input")
+        guide_ptr, guide_stride, _, _, guide_channels = _describe(guide)
+    _check(_lib.ik_guided(src, src_stride, dst, dst_stride, width, height, channels,
+                          guide_ptr, guide_stride, guide_channels, radius, eps))
+    return out
+
+def histogram(image):
+    # shape (256,) for a gray image, (channels, 256) otherwise
+    src, src_stride, width, height, channels = _describe(image)
+    bins = np.zeros((channels, 256), dtype=np.int64)
+    _check(_lib.ik_histogram(src, src_stride, width, height, channels, bins.ctypes.data))
+    return bins[0] if image.ndim == 2 else bins
+
+def apply_lut(image, lut, out=None):
+    lut = np.ascontiguousarray(lut, dtype=np.uint8)
+    if lut.shape != (256,):
+        raise ValueError("lut must have 256 entries")
+    out = _output(image, out)
+    src, src_stride, width, height, channels = _describe(image)
+    dst, dst_stride = _describe(out)[:2]
+    _check(_lib.ik_apply_lut(src, src_stride, dst, dst_stride, width, height, channels, lut.ctypes.data))
+    return out
+
+def bgr_to_yuv(image):
+    # returns the Y, U and V planes
+    src, src_stride, width, height, channels = _describe(image)
+    if channels != 3:
+        raise ValueError("Expected a BGR image")
+    planes = [np.empty((height, width), dtype=np.uint8) for _ in range(3)]
+    _check(_lib.ik_bgr_to_yuv(src, src_stride, width, height,
+                              planes[0].ctypes.data, width, planes[1].ctypes.data, width,
+                              planes[2].ctypes.data, width))
+    return planes
+
+def mse(a, b):
+    if a.shape != b.shape:
+        raise ValueError("Images must have the same size for MSE calculation.")
+    a_ptr, a_stride, width, height, channels = _describe(a)
+    b_ptr, b_stride = _describe(b)[:2]
+    result = ctypes.c_double()
+    _check(_lib.ik_mse(a_ptr, a_stride, b_ptr, b_stride, width, height, channels, ctypes.byref(result)))
+    return result.value
+
+def psnr(a, b):
+    error = mse(a, b)
+    return float('inf') if error == 0 else 10 * np.log10(255.0 * 255.0 / error)
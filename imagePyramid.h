@@ -0,0 +1,139 @@
+// Image pyramid and joint bilateral upsampling (Kopf, Cohen, Lischinski and Uyttendaele)
+//
+// Preview renders run an expensive operator on a coarse pyramid level and bring the result
+// back to full resolution with joint bilateral upsampling: each full-resolution pixel
+// averages the low-resolution result around its position, weighted by a spatial Gaussian
+// (in low-resolution pixels) and by how close the guide at that low-resolution sample is to
+// the full-resolution guide at the pixel. Edges of the guide therefore stay sharp even
+// though the operator only saw a quarter (or a sixteenth, ...) of the pixels.
+//
+// Levels halve each side (rounding up) with a 2 x 2 box average, edges replicated.
+
+#ifndef IMAGE_PYRAMID_H
+#define IMAGE_PYRAMID_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+struct PyramidLevel {
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;  // interleaved, same channel count as the base image
+};
+
+// Function: levels + 1 images, level 0 being a copy of the input
+inline std::vector<PyramidLevel> buildImagePyramid(const std::vector<unsigned char>& image,
+                                                   int width,
+                                                   int height,
+                                                   int channels,
+                                                   int levels) {
+    std::vector<PyramidLevel> pyramid(1);
+    pyramid[0].width = width;
+    pyramid[0].height = height;
+    pyramid[0].pixels = image;
+
+    for (int level = 1; level <= levels; ++level) {
+        const PyramidLevel& fine = pyramid[level - 1];
+        PyramidLevel coarse;
+        coarse.width = (fine.width + 1) / 2;
+        coarse.height = (fine.height + 1) / 2;
+        coarse.pixels.resize(static_cast<size_t>(coarse.width) * coarse.height * channels);
+
+        for (int y = 0; y < coarse.height; ++y) {
+            const unsigned char* row0 = &fine.pixels[static_cast<size_t>(2 * y) * fine.width * channels];
+            const unsigned char* row1 = &fine.pixels[static_cast<size_t>(std::min(2 * y + 1, fine.height - 1)) * fine.width * channels];
+            unsigned char* out = &coarse.pixels[static_cast<size_t>(y) * coarse.width * channels];
+            for (int x = 0; x < coarse.width; ++x) {
+                int x0 = 2 * x * channels;
+                int x1 = std::min(2 * x + 1, fine.width - 1) * channels;
+                for (int c = 0; c < channels; ++c) {
+                    out[x * channels + c] = static_cast<unsigned char>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                }
+            }
+        }
+        pyramid.push_back(coarse);
+    }
+    return pyramid;
+}
+
+// Function: joint bilateral upsampling of a result computed on pyramid level `levels`
+// low, lowGuide: lowWidth x lowHeight (result and the guide's pyramid level), guide and
+// output: width x height, all with the same interleaved channel count.
+// radius: taps on each side in low-resolution pixels (2: a 4 x 4 footprint),
+// sigmaSpace in low-resolution pixels, sigmaRange in gray levels (summed over channels)
+inline void jointBilateralUpsample(const std::vector<unsigned char>& low,
+                                   const std::vector<unsigned char>& lowGuide,
+                                   int lowWidth,
+                                   int lowHeight,
+                                   const std::vector<unsigned char>& guide,
+                                   int width,
+                                   int height,
+                                   int channels,
+                                   int levels,
+                                   std::vector<unsigned char>& output,
+                                   int radius = 2,
+                                   double sigmaSpace = 1.0,
+                                   double sigmaRange = 20.0) {
+    const int scale = 1 << levels;
+    const int taps = 2 * radius;
+    output.resize(static_cast<size_t>(width) * height * channels);
+
+    // the low-resolution position of a pixel only depends on its phase modulo scale, so the
+    // separable spatial weights are tabulated per phase: (phase, tap) -> weight
+    std::vector<double> spatial(static_cast<size_t>(scale) * taps);
+    for (int phase = 0; phase < scale; ++phase) {
+        double position = (phase + 0.5) / scale - 0.5;
+        int first = static_cast<int>(std::floor(position)) - radius + 1;
+        for (int t = 0; t < taps; ++t) {
+            double d = first + t - position;
+            spatial[phase * taps + t] = std::exp(-(d * d) / (2.0 * sigmaSpace * sigmaSpace));
+        }
+    }
+    // range weights by summed |difference| (floored, so a pixel unlike all of its samples
+    // falls back to the spatial weights)
+    std::vector<double> range(256 * channels);
+    for (size_t d = 0; d < range.size(); ++d) {
+        range[d] = std::max(std::exp(-(static_cast<double>(d) * d) / (2.0 * sigmaRange * sigmaRange)), 1e-12);
+    }
+
+    std::vector<double> sums(channels);
+    for (int y = 0; y < height; ++y) {
+        double positionY = (y + 0.5) / scale - 0.5;
+        int firstY = static_cast<int>(std::floor(positionY)) - radius + 1;
+        const double* weightsY = &spatial[(y % scale) * taps];
+        for (int x = 0; x < width; ++x) {
+            double positionX = (x + 0.5) / scale - 0.5;
+            int firstX = static_cast<int>(std::floor(positionX)) - radius + 1;
+            const double* weightsX = &spatial[(x % scale) * taps];
+            const unsigned char* center = &guide[(static_cast<size_t>(y) * width + x) * channels];
+
+            double weightSum = 0.0;
+            std::fill(sums.begin(), sums.end(), 0.0);
+            for (int ty = 0; ty < taps; ++ty) {
+                int ly = std::min(std::max(firstY + ty, 0), lowHeight - 1);
+                for (int tx = 0; tx < taps; ++tx) {
+                    int lx = std::min(std::max(firstX + tx, 0), lowWidth - 1);
+                    size_t sample = (static_cast<size_t>(ly) * lowWidth + lx) * channels;
+                    int distance = 0;
+                    for (int c = 0; c < channels; ++c) {
+                        distance += std::abs(center[c] - lowGuide[sample + c]);
+                    }
+                    double w = weightsY[ty] * weightsX[tx] * range[distance];
+                    weightSum += w;
+                    for (int c = 0; c < channels; ++c) {
+                        sums[c] += w * low[sample + c];
+                    }
+                }
+            }
+
+            unsigned char* out = &output[(static_cast<size_t>(y) * width + x) * channels];
+            for (int c = 0; c < channels; ++c) {
+                out[c] = static_cast<unsigned char>(std::min(std::max(static_cast<int>(sums[c] / weightSum + 0.5), 0), 255));
+            }
+        }
+    }
+}
+
+#endif // IMAGE_PYRAMID_H
@@ -0,0 +1,393 @@
+// Allocation and peak-memory profile per named pipeline stage
+//
+// A stage is a scope: MemoryStage stage("median"); everything the thread allocates while it
+// is the innermost stage is charged to it (nested stages take over until they close). Per
+// stage the profile keeps
+//   - calls, allocations and bytes allocated
+//   - net bytes: allocated by the stage minus those of its blocks freed since, wherever the
+//     free happens, i.e. what it leaves behind (an output image, grown scratch); the peak of
+//     that running sum is the stage's own transient high-water mark
+//   - RSS at the stage's exits, from /proc/self/status: the largest VmRSS, and by how much
+//     the process peak (VmHWM) grew while it ran, summed over its calls (stages running
+//     concurrently each see the whole growth) - the stages that set the container's
+//     memory limit are the ones with a non-zero growth
+// printMemoryProfile prints a table, plus the process totals (peak of the tracked heap and
+// VmHWM).
+//
+// Counting hooks the global operator new / delete in all their forms - plain, array,
+// nothrow, sized and (C++17) over-aligned - so every std::vector image buffer goes through
+// it. The replacement operators are defined in the one translation unit that defines
+// MEMORY_PROFILER_IMPLEMENTATION before including this header (p2d and p3 do so only when
+// built with -DMEMORY_PROFILE_BUILD, so default builds keep the system allocator; without
+// the hooks the table has the stage calls and RSS columns only). Every block they hand out
+// carries a 16-byte header just before it, holding the bytes charged for it and the stage
+// they were charged to: a free is taken back from that stage, and not at all for a block
+// allocated while the profiler was off (profiling can be switched on at any time with
+// enableMemoryProfiler()), so no count goes negative. While it is off a
+// hooked allocation costs one relaxed atomic load and the header.
+
+#ifndef MEMORY_PROFILER_H
+#define MEMORY_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+
+#if defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+const int MEMORY_PROFILER_MAX_STAGES = 64;
+
+struct MemoryStageStats {
+    char name[48];
+    std::atomic<int64_t> calls{0};
+    std::atomic<int64_t> allocations{0};
+    std::atomic<int64_t> allocatedBytes{0};
+    std::atomic<int64_t> netBytes{0};           // allocated by the stage - freed of those blocks
+    std::atomic<int64_t> peakNetBytes{0};
+    std::atomic<int64_t> peakRssBytes{0};       // largest VmRSS seen at an exit of the stage
+    std::atomic<int64_t> hwmGrowthBytes{0};     // sum over calls of the VmHWM increase
+};
+
+struct MemoryProfile {
+    std::atomic<bool> enabled{false};
+    std::atomic<bool> heapHooked{false};                    // the replacement operators are linked in
+    std::mutex registryMutex;
+    std::atomic<int> stageCount{0};
+    MemoryStageStats stages[MEMORY_PROFILER_MAX_STAGES];   // stage 0: allocations outside any stage
+    std::atomic<int64_t> liveBytes{0};
+    std::atomic<int64_t> peakLiveBytes{0};
+};
+
+// Helper function: the process-wide profile (constant-initialized, usable from operator new
+// before main)
+inline MemoryProfile& memoryProfile() {
+    static MemoryProfile profile;
+    return profile;
+}
+
+// Helper function: the calling thread's innermost stage (0: none)
+inline int& currentMemoryStage() {
+    static thread_local int stage = 0;
+    return stage;
+}
+
+// Helper function: raise an atomic maximum
+inline void raiseAtomicMax(std::atomic<int64_t>& maximum, int64_t value) {
+    int64_t seen = maximum.load(std::memory_order_relaxed);
+    while (value > seen && !maximum.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+// Function: current and peak resident set size in bytes (VmRSS / VmHWM of /proc/self/status;
+// elsewhere only the peak, from getrusage). Does not allocate.
+inline void readResidentSetSize(int64_t& rssBytes, int64_t& peakRssBytes) {
+    rssBytes = 0;
+    peakRssBytes = 0;
+#if defined(__linux__)
+    std::FILE* status = std::fopen("/proc/self/status", "r");
+    if (status == nullptr) {
+        return;
+    }
+    char line[256];
+    while (std::fgets(line, sizeof(line), status) != nullptr) {
+        long long kilobytes = 0;
+        if (std::sscanf(line, "VmRSS: %lld kB", &kilobytes) == 1) {
+            rssBytes = kilobytes * 1024;
+        } else if (std::sscanf(line, "VmHWM: %lld kB", &kilobytes) == 1) {
+            peakRssBytes = kilobytes * 1024;
+        }
+    }
+    std::fclose(status);
+#elif defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peakRssBytes = usage.ru_maxrss;   // bytes on macOS
+    }
+#endif
+}
+
+// Function: start counting (allocations made before this are not in the profile)
+inline void enableMemoryProfiler() {
+    MemoryProfile& profile = memoryProfile();
+    std::lock_guard<std::mutex> lock(profile.registryMutex);
+    if (profile.stageCount.load() == 0) {
+        std::strcpy(profile.stages[0].name, "(outside stages)");
+        profile.stageCount.store(1);
+    }
+    profile.enabled.store(true);
+}
+
+// Function: index of a named stage, registered on first use (names are truncated to 47
+// characters; past MEMORY_PROFILER_MAX_STAGES everything goes to stage 0)
+inline int memoryStageIndex(const char* name) {
+    MemoryProfile& profile = memoryProfile();
+    std::lock_guard<std::mutex> lock(profile.registryMutex);
+    int count = profile.stageCount.load();
+    for (int i = 1; i < count; ++i) {
+        if (std::strncmp(profile.stages[i].name, name, sizeof(profile.stages[i].name) - 1) == 0) {
+            return i;
+        }
+    }
+    if (count == MEMORY_PROFILER_MAX_STAGES) {
+        return 0;
+    }
+    std::strncpy(profile.stages[count].name, name, sizeof(profile.stages[count].name) - 1);
+    profile.stages[count].name[sizeof(profile.stages[count].name) - 1] = '\0';
+    profile.stageCount.store(count + 1);
+    return count;
+}
+
+// Helper function: charge an allocation (bytes > 0) or a free (bytes < 0) to a stage
+inline void recordHeapChange(int64_t bytes, int stageIndex) {
+    MemoryProfile& profile = memoryProfile();
+    MemoryStageStats& stage = profile.stages[stageIndex];
+    if (bytes > 0) {
+        stage.allocations.fetch_add(1, std::memory_order_relaxed);
+        stage.allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    raiseAtomicMax(stage.peakNetBytes, stage.netBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    raiseAtomicMax(profile.peakLiveBytes, profile.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+// Scope: charge this thread's allocations to a named stage until the end of the scope
+// (does nothing while the profiler is off)
+class MemoryStage {
+public:
+    explicit MemoryStage(const char* name) {
+        if (!memoryProfile().enabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        active_ = true;
+        int64_t rss;
+        readResidentSetSize(rss, peakRssAtEntry_);
+        previous_ = currentMemoryStage();
+        currentMemoryStage() = index_ = memoryStageIndex(name);
+    }
+
+    ~MemoryStage() {
+        if (!active_) {
+            return;
+        }
+        currentMemoryStage() = previous_;
+        MemoryStageStats& stage = memoryProfile().stages[index_];
+        int64_t rss, peakRss;
+        readResidentSetSize(rss, peakRss);
+        stage.calls.fetch_add(1, std::memory_order_relaxed);
+        raiseAtomicMax(stage.peakRssBytes, rss);
+        stage.hwmGrowthBytes.fetch_add(std::max<int64_t>(0, peakRss - peakRssAtEntry_), std::memory_order_relaxed);
+    }
+
+    MemoryStage(const MemoryStage&) = delete;
+    MemoryStage& operator=(const MemoryStage&) = delete;
+
+private:
+    bool active_ = false;
+    int index_ = 0;
+    int previous_ = 0;
+    int64_t peakRssAtEntry_ = 0;
+};
+
+// Function: print the per-stage table and the process totals
+inline void printMemoryProfile(std::ostream& out) {
+    MemoryProfile& profile = memoryProfile();
+    const double MB = 1024.0 * 1024.0;
+    out << std::left << std::setw(24) << "stage" << std::right
+        << std::setw(7) << "calls" << std::setw(9) << "allocs" << std::setw(13) << "alloc MB"
+        << std::setw(11) << "net MB" << std::setw(13) << "peak net MB" << std::setw(13) << "max RSS MB"
+        << std::setw(14) << "HWM grew MB" << std::endl;
+    out << std::fixed << std::setprecision(2);
+    for (int i = 0; i < profile.stageCount.load(); ++i) {
+        const MemoryStageStats& stage = profile.stages[i];
+        if (stage.allocations.load() == 0 && stage.calls.load() == 0) {
+            continue;
+        }
+        out << std::left << std::setw(24) << stage.name << std::right
+            << std::setw(7) << stage.calls.load() << std::setw(9) << stage.allocations.load()
+            << std::setw(13) << stage.allocatedBytes.load() / MB << std::setw(11) << stage.netBytes.load() / MB
+            << std::setw(13) << stage.peakNetBytes.load() / MB << std::setw(13) << stage.peakRssBytes.load() / MB
+            << std::setw(14) << stage.hwmGrowthBytes.load() / MB << std::endl;
+    }
+    int64_t rss, peakRss;
+    readResidentSetSize(rss, peakRss);
+    if (!profile.heapHooked.load()) {
+        out << "heap not tracked: build with -DMEMORY_PROFILE_BUILD for the allocation columns" << std::endl;
+    }
+    out << "tracked heap: " << profile.liveBytes.load() / MB << " MB live, "
+        << profile.peakLiveBytes.load() / MB << " MB peak; process RSS: " << rss / MB << " MB, peak (VmHWM) "
+        << peakRss / MB << " MB" << std::endl;
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
+
+#endif // MEMORY_PROFILER_H
+
+// Replacement global allocation functions, in the one translation unit that asks for them
+#if defined(MEMORY_PROFILER_IMPLEMENTATION) && !defined(MEMORY_PROFILER_IMPLEMENTED)
+#define MEMORY_PROFILER_IMPLEMENTED
+
+#include <cstdlib>
+#include <new>
+
+// the replacement operators below are linked in: printMemoryProfile reports the heap columns
+static const bool memoryProfilerHeapHooked = (memoryProfile().heapHooked = true);
+
+// header in front of every hooked block: the bytes charged for it (0: allocated while the
+// profiler was off), the stage charged and the distance back to the start of the underlying
+// allocation
+struct alignas(16) HeapBlockHeader {
+    int64_t chargedBytes;
+    int32_t stage;
+    int32_t offset;
+};
+
+// Helper function: allocate size bytes aligned to `alignment` (at least 16) behind a header
+inline void* allocateTracked(size_t size, size_t alignment) {
+    const size_t offset = std::max(alignment, sizeof(HeapBlockHeader));
+    if (size > SIZE_MAX - 2 * offset) {
+        return nullptr;
+    }
+    void* raw = alignment <= alignof(std::max_align_t)
+                    ? std::malloc(size + offset)
+                    : std::aligned_alloc(alignment, (size + offset + alignment - 1) / alignment * alignment);
+    if (raw == nullptr) {
+        return nullptr;
+    }
+    unsigned char* block = static_cast<unsigned char*>(raw) + offset;
+    HeapBlockHeader* header = reinterpret_cast<HeapBlockHeader*>(block) - 1;
+    header->chargedBytes = 0;
+    header->stage = 0;
+    header->offset = static_cast<int32_t>(offset);
+    if (memoryProfile().enabled.load(std::memory_order_relaxed)) {
+        header->chargedBytes = static_cast<int64_t>(size);
+        header->stage = currentMemoryStage();
+        recordHeapChange(header->chargedBytes, header->stage);
+    }
+    return block;
+}
+
+// Helper function: free a block of allocateTracked, uncharging it if it was counted
+inline void freeTracked(void* block) {
+    if (block == nullptr) {
+        return;
+    }
+    HeapBlockHeader* header = static_cast<HeapBlockHeader*>(block) - 1;
+    if (header->chargedBytes != 0) {
+        recordHeapChange(-header->chargedBytes, header->stage);
+    }
+    std::free(static_cast<unsigned char*>(block) - header->offset);
+}
+
+// Helper function: allocate or throw std::bad_alloc (after trying the new handler)
+inline void* allocateTrackedOrThrow(size_t size, size_t alignment) {
+    for (;;) {
+        void* block = allocateTracked(size == 0 ? 1 : size, alignment);
+        if (block != nullptr) {
+            return block;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* operator new(size_t size) {
+    return allocateTrackedOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size) {
+    return allocateTrackedOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocateTrackedOrThrow(size, alignof(std::max_align_t));
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* block) noexcept {
+    freeTracked(block);
+}
+
+void operator delete[](void* block) noexcept {
+    freeTracked(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    freeTracked(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    freeTracked(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+    freeTracked(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+    freeTracked(block);
+}
+
+#if defined(__cpp_aligned_new)
+void* operator new(size_t size, std::align_val_t alignment) {
+    return allocateTrackedOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return allocateTrackedOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    try {
+        return allocateTrackedOrThrow(size, static_cast<size_t>(alignment));
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void* block, std::align_val_t) noexcept {
+    freeTracked(block);
+}
+
+void operator delete[](void* block, std::align_val_t) noexcept {
+    freeTracked(block);
+}
+
+void operator delete(void* block, size_t, std::align_val_t) noexcept {
+    freeTracked(block);
+}
+
+void operator delete[](void* block, size_t, std::align_val_t) noexcept {
+    freeTracked(block);
+}
+
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept {
+    freeTracked(block);
+}
+
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept {
+    freeTracked(block);
+}
+#endif
+
+#endif // MEMORY_PROFILER_IMPLEMENTATION
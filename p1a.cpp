@@ -3,6 +3,11 @@
 #include <vector>
 #include <cmath>
 
+#include "imageDiff.h"
+
+// diff map mode: also save the per-channel absolute difference against House_ori
+// (./outputs/House_diff.raw) next to the statistics
+const bool DIFF_MAP_MODE = false;
 
 // Function to save a raw image
 void saveRawImage(const std::string& filename, 
@@ -25,25 +30,31 @@ void saveRawImage(const std::string& filename,
     outFile.close();
 }
 
+// Bayer pattern of House.raw (GRBG, as in p1d): green where x + y is even, red at even row /
+// odd column, blue at odd row / even column. House_ori.raw stores R, G, B per pixel.
+const int CROSS_NEIGHBOURS[4][2] = {{0, -1}, {-1, 0}, {1, 0}, {0, 1}};
+const int DIAGONAL_NEIGHBOURS[4][2] = {{-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+const int HORIZONTAL_NEIGHBOURS[2][2] = {{-1, 0}, {1, 0}};
+const int VERTICAL_NEIGHBOURS[2][2] = {{0, -1}, {0, 1}};
+
 // Function to perform bilinear interpolation on a single channel
+// (average of the given neighbours of (x, y) in the single-channel mosaic that lie inside it)
 unsigned char bilinearInterpolate(const std::vector<unsigned char>& rawData, 
                                   int x, 
                                   int y, 
                                   int width, 
-                                  int height, 
-                                  int channelOffset, 
-                                  int channelStep) {
+                                  int height,
+                                  const int (*neighbours)[2],
+                                  int neighbourCount) {
     int sum = 0;
     int count = 0;
 
-    for (int dy = -1; dy <= 1; dy += 2) {
-        for (int dx = -1; dx <= 1; dx += 2) {
-            int newX = x + dx;
-            int newY = y + dy;
-            if (newX >= 0 && newX < width && newY >= 0 && newY < height) {
-                sum += rawData[(newY * width + newX) * 3 + channelOffset];
-                count++;
-            }
+    for (int i = 0; i < neighbourCount; ++i) {
+        int newX = x + neighbours[i][0];
+        int newY = y + neighbours[i][1];
+        if (newX >= 0 && newX < width && newY >= 0 && newY < height) {
+            sum += rawData[static_cast<size_t>(newY) * width + newX];
+            count++;
         }
     }
 
@@ -57,30 +68,27 @@ void bilinearDemosaicing(const std::vector<unsigned char>& rawData,
 
     for (int y = 0; y < height; ++y) {
         for (int x = 0; x < width; ++x) {
-            int index = (y * width + x) * 3; // Output index for BGR image
-
-            if ((y % 2 == 0) && (x % 2 == 0)) {
-                // Current pixel is red
-                outputData[index + 2] = rawData[y * width + x]; // Red channel
-                outputData[index + 1] = bilinearInterpolate(rawData, x, y, width, height, 1, 3); // Green channel
-                outputData[index] = bilinearInterpolate(rawData, x, y, width, height, 0, 3); // Blue channel
-            } else if ((y % 2 == 1) && (x % 2 == 1)) {
-                // Current pixel is blue
-                outputData[index] = rawData[y * width + x]; // Blue channel
-                outputData[index + 1] = bilinearInterpolate(rawData, x, y, width, height, 1, 3); // Green channel
-                outputData[index + 2] = bilinearInterpolate(rawData, x, y, width, height, 2, 3); // Red channel
+            size_t index = (static_cast<size_t>(y) * width + x) * 3; // Output index, R G B like House_ori
+            unsigned char sample = rawData[static_cast<size_t>(y) * width + x];
+
+            if ((x + y) % 2 == 1) {
+                // red or blue site: green from the 4 direct neighbours, the other color from
+                // the 4 diagonal ones
+                unsigned char green = bilinearInterpolate(rawData, x, y, width, height, CROSS_NEIGHBOURS, 4);
+                unsigned char other = bilinearInterpolate(rawData, x, y, width, height, DIAGONAL_NEIGHBOURS, 4);
+                bool redSite = (y % 2 == 0);
+                outputData[index] = redSite ? sample : other; // Red channel
+                outputData[index + 1] = green; // Green channel
+                outputData[index + 2] = redSite ? other : sample; // Blue channel
             } else {
-                // Current pixel is green
-                outputData[index + 1] = rawData[y * width + x]; // Green channel
-            }
-
-             // Bilinearly interpolate red and blue based on row parity
-            if (y % 2 == 0) {
-                outputData[index + 2] = bilinearInterpolate(rawData, x, y, width, height, 2, 3); // Red channel
-                outputData[index] = (x > 0) ? rawData[y * width + (x - 1)] : rawData[y * width + (x + 1)]; // Blue channel
-            } else {
-                outputData[index] = bilinearInterpolate(rawData, x, y, width, height, 0, 3); // Blue channel
-                outputData[index + 2] = (x > 0) ? rawData[y * width + (x - 1)] : rawData[y * width + (x + 1)]; // Red channel
+                // green site: the color of its row from the left / right neighbours, the other
+                // from the ones above / below
+                unsigned char rowColor = bilinearInterpolate(rawData, x, y, width, height, HORIZONTAL_NEIGHBOURS, 2);
+                unsigned char columnColor = bilinearInterpolate(rawData, x, y, width, height, VERTICAL_NEIGHBOURS, 2);
+                bool redRow = (y % 2 == 0);
+                outputData[index] = redRow ? rowColor : columnColor; // Red channel
+                outputData[index + 1] = sample; // Green channel
+                outputData[index + 2] = redRow ? columnColor : rowColor; // Blue channel
             }
         }
     }
@@ -92,31 +100,32 @@ void bilinearDemosaicing(const std::vector<unsigned char>& rawData,
 
 
 // Function to compare two images
+// (one diff pass with the statistics; maxListed > 0 also lists the first significant pixels,
+// and a non-empty diffMapFile saves the per-channel absolute difference image)
 void compareImages(const std::vector<unsigned char>& image1, 
                    const std::vector<unsigned char>& image2, 
                    int width, 
-                   int height) {
+                   int height,
+                   int maxListed = 0,
+                   const std::string& diffMapFile = "") {
+    if (image1.size() < static_cast<size_t>(width) * height * 3 || image2.size() < static_cast<size_t>(width) * height * 3) {
+        std::cerr << "Images are smaller than " << width << "x" << height << "x3!" << std::endl;
+        return;
+    }
+
     // threshold for significant difference
-    const unsigned char threshold = 10; 
-    int count = 0;
+    ImageDiffOptions options;
+    options.threshold = 10;
+    options.maxListed = maxListed;
+    options.diffMap = !diffMapFile.empty();
 
-    for (size_t i = 0; i < width * height * 3; i += 3) {
-        // Compute absolute difference for each channel
-        unsigned char diffB = std::abs(image1[i] - image2[i]);
-        unsigned char diffG = std::abs(image1[i + 1] - image2[i + 1]);
-        unsigned char diffR = std::abs(image1[i + 2] - image2[i + 2]);
-
-        if (diffB > threshold || diffG > threshold || diffR > threshold) {
-            size_t pixelIdx = i / 3;
-            std::cout << "Significant difference at pixel " << pixelIdx << 
-            ", with B:" << static_cast<int>(diffB) <<
-            ", G:" << static_cast<int>(diffG) <<
-            ", R:" << static_cast<int>(diffR) << " intensity differences." << std::endl;
-            count++;
-        }
-    }
+    ImageDiffReport report = diffImages(image1.data(), image2.data(), width, height, 3, options);
+    printDiffReport(report, std::cout);
+    std::cout << "Total number of pixels with significant differences: " << report.significantPixels << std::endl;
 
-    std::cout << "Total number of pixels with significant differences: " << count << std::endl;
+    if (options.diffMap) {
+        saveRawImage(diffMapFile, report.diffMap, width, height);
+    }
 }
 
 // main
@@ -134,12 +143,12 @@ int main() {
     }
 
     // read the raw data
-    std::vector<unsigned char> rawData(width * height);
+    std::vector<unsigned char> rawData(static_cast<size_t>(width) * height);
     file.read(reinterpret_cast<char*>(rawData.data()), rawData.size());
     file.close();
 
     // output data
-    std::vector<unsigned char> outputImage(width * height * 3); // Output image (BGR)
+    std::vector<unsigned char> outputImage(static_cast<size_t>(width) * height * 3); // Output image (RGB)
 
     // perform bilinear demosaicing
     bilinearDemosaicing(rawData, outputImage, width, height);
@@ -151,12 +160,12 @@ int main() {
         std::cerr << "Error opening file!" << std::endl;
         return 1; // Error code
     }
-    std::vector<unsigned char> rawData2(width * height);
+    std::vector<unsigned char> rawData2(static_cast<size_t>(width) * height * 3);
     file2.read(reinterpret_cast<char*>(rawData2.data()), rawData2.size());
     file2.close();
 
     // compare the images
-    compareImages(outputImage, rawData2, width, height);
+    compareImages(outputImage, rawData2, width, height, 0, DIFF_MAP_MODE ? "./outputs/House_diff.raw" : "");
 
     return 0;
 }
\ No newline at end of file
@@ -6,6 +6,13 @@
 #include <string>
 #include <functional>
 
+#include "exactBucketFill.h"
+
+// exact bucket filling: rank every pixel (value, then BUCKET_TIE_BREAK) with a parallel
+// counting sort for an exactly flat histogram, instead of mapping whole gray values
+const bool EXACT_BUCKET_MODE = false;
+const BucketTieBreak BUCKET_TIE_BREAK = BUCKET_TIE_LOCAL_MEAN;
+
 // Function: transfer function
 void transferFunction(const std::string &inputFile, 
                       const std::string &outputFile,
@@ -71,21 +78,8 @@ void transferFunction(const std::string &inputFile,
 }
 
 
-// Function: bucket filling
-void bucketFilling(const std::string &inputFile, 
-                    const std::string &outputFile,
-                    int width, 
-                    int height) {
-    // read the image data from file
-    std::ifstream file(inputFile, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Unable to open file " << inputFile << std::endl;
-        return;
-    }
-    std::vector<unsigned char> image(width * height);
-    file.read(reinterpret_cast<char*>(image.data()), image.size());
-    file.close();
-
+// Sub-function: bucket filling by gray value (every pixel of a value goes to one bucket)
+void bucketFillByValue(std::vector<unsigned char>& image, int width, int height) {
     // calculate the histogram
     int histogram[256] = {0};
     for (unsigned char pixel : image) {
@@ -121,6 +115,28 @@ void bucketFilling(const std::string &inputFile,
     for (unsigned char &pixel : image) {
         pixel = new_values[pixel];
     }
+}
+
+// Function: bucket filling
+void bucketFilling(const std::string &inputFile, 
+                    const std::string &outputFile,
+                    int width, 
+                    int height) {
+    // read the image data from file
+    std::ifstream file(inputFile, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Unable to open file " << inputFile << std::endl;
+        return;
+    }
+    std::vector<unsigned char> image(width * height);
+    file.read(reinterpret_cast<char*>(image.data()), image.size());
+    file.close();
+
+    if (EXACT_BUCKET_MODE) {
+        exactBucketFill(image, width, height, BUCKET_TIE_BREAK);
+    } else {
+        bucketFillByValue(image, width, height);
+    }
 
     // write the enhanced image to a file
     std::ofstream outFile(outputFile, std::ios::binary);
@@ -2,6 +2,13 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <functional>
+
+#include "tiledImage.h"
+#include "exactBucketFill.h"
 
 
 struct RGB {
@@ -16,6 +23,37 @@ struct YUV {
     unsigned char v;
 };
 
+// Y, U and V planes of an image; the enhancements only ever touch Y
+struct YUVPlanes {
+    std::vector<unsigned char> y;
+    std::vector<unsigned char> u;
+    std::vector<unsigned char> v;
+};
+
+// out-of-core CLAHE: the Y plane goes through tiled files (tiledImage.h) and is equalized
+// block by block with global tile histograms (for images that do not fit in RAM)
+const bool OUT_OF_CORE_MODE = false;
+
+// branching pipeline: the input is converted to Y/U/V once and every enhancement runs in its
+// own thread on its own copy of the source Y plane; the output conversions share U and V.
+// false: the original chain (transfer function -> bucket filling -> CLAHE on one image)
+const bool BRANCHING_MODE = true;
+
+// exact bucket filling: rank every Y value (value, then BUCKET_TIE_BREAK) with a parallel
+// counting sort for an exactly flat histogram, instead of mapping whole gray values
+const bool EXACT_BUCKET_MODE = false;
+const BucketTieBreak BUCKET_TIE_BREAK = BUCKET_TIE_LOCAL_MEAN;
+
+// sliding-window CLAHE: also equalize every pixel with the clipped histogram of its own
+// windowSize window (much slower than the tiled CLAHE) and save it as CityDefogged_SWCLAHE.raw
+const bool SLIDING_WINDOW_CLAHE = false;
+
+// sliding-window band check: with SLIDING_WINDOW_CLAHE, also run it split into
+// SLIDING_WINDOW_CHECK_BANDS row bands and as one band, and report the pixels that differ
+// (any difference is a bug in the band setup)
+const bool SLIDING_WINDOW_CHECK = false;
+const int SLIDING_WINDOW_CHECK_BANDS = 7;
+
 YUV rgbToYuv(const RGB& rgb) {
     YUV yuv;
     yuv.y = static_cast<unsigned char>(0.257 * rgb.r + 0.504 * rgb.g + 0.098 * rgb.b + 16);
@@ -33,8 +71,8 @@ RGB yuvToRgb(const YUV& yuv) {
 }
 
 
-// Function: transform RGB to YUV
-void transformRGBToYUV(std::vector<YUV>& yuvImage,
+// Function: transform RGB to planar YUV
+bool transformRGBToYUV(YUVPlanes& planes,
                        const std::string &inputFile,
                        int width,
                        int height) {
@@ -42,7 +80,7 @@ void transformRGBToYUV(std::vector<YUV>& yuvImage,
     std::ifstream file(inputFile, std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Unable to open file " << inputFile << std::endl;
-        return;
+        return false;
     }
 
     // read the RGB data from the file
@@ -50,21 +88,30 @@ void transformRGBToYUV(std::vector<YUV>& yuvImage,
     file.read(reinterpret_cast<char*>(rgbImage.data()), rgbImage.size() * sizeof(RGB));
     file.close();
 
-    for (const auto& pixel : rgbImage) {
-        yuvImage.push_back(rgbToYuv(pixel));
+    planes.y.resize(rgbImage.size());
+    planes.u.resize(rgbImage.size());
+    planes.v.resize(rgbImage.size());
+    for (size_t i = 0; i < rgbImage.size(); ++i) {
+        YUV yuv = rgbToYuv(rgbImage[i]);
+        planes.y[i] = yuv.y;
+        planes.u[i] = yuv.u;
+        planes.v[i] = yuv.v;
     }
+    return true;
 }
 
-// Function: transform YUV to RGB and store in a raw file
-void transformYUVToRGB(const std::vector<YUV>& yuvImage, 
-                      const std::string &outputFile) {
+// Function: transform YUV planes to RGB and store in a raw file
+void transformYUVToRGB(const std::vector<unsigned char>& yPlane,
+                       const std::vector<unsigned char>& uPlane,
+                       const std::vector<unsigned char>& vPlane,
+                       const std::string &outputFile) {
     
     // create a vector to store the RGB values
-    std::vector<RGB> rgbImage;
+    std::vector<RGB> rgbImage(yPlane.size());
 
     // transform YUV to RGB and store in rgbImage
-    for (const auto& pixel : yuvImage) {
-        rgbImage.push_back(yuvToRgb(pixel));
+    for (size_t i = 0; i < yPlane.size(); ++i) {
+        rgbImage[i] = yuvToRgb({yPlane[i], uPlane[i], vPlane[i]});
     }
 
     // store the RGB values in a output raw file
@@ -78,13 +125,13 @@ void transformYUVToRGB(const std::vector<YUV>& yuvImage,
 
 
 // Function: transfer function for Y channel ============================================================================
-void transferFunctionYChannel(std::vector<YUV>& yuvImage, 
+void transferFunctionYChannel(std::vector<unsigned char>& yPlane, 
                               int width, 
                               int height) {
     // count the frequency of pixels for each grayscale value in the Y channel
     int frequency[256] = {0};
-    for (const auto& pixel : yuvImage) {
-        frequency[pixel.y]++;
+    for (unsigned char value : yPlane) {
+        frequency[value]++;
     }
 
     // calculate probability of each grayscale value in the Y channel
@@ -110,20 +157,25 @@ void transferFunctionYChannel(std::vector<YUV>& yuvImage,
     }
 
     // apply mapping to get enhanced Y channel
-    for (auto& pixel : yuvImage) {
-        pixel.y = mapping[pixel.y];
+    for (auto& value : yPlane) {
+        value = mapping[value];
     }
 }
 
 
 // Function: bucket filling for Y channel ==============================================================================
-void bucketFillingYChannel(std::vector<YUV>& yuvImage, 
+void bucketFillingYChannel(std::vector<unsigned char>& yPlane, 
                            int width, 
                            int height) {
+    if (EXACT_BUCKET_MODE) {
+        exactBucketFill(yPlane, width, height, BUCKET_TIE_BREAK);
+        return;
+    }
+
     // calculate the histogram for the Y channel
     int histogram[256] = {0};
-    for (const auto& pixel : yuvImage) {
-        histogram[pixel.y]++;
+    for (unsigned char value : yPlane) {
+        histogram[value]++;
     }
 
     // total number of pixels
@@ -151,8 +203,8 @@ void bucketFillingYChannel(std::vector<YUV>& yuvImage,
     }
 
     // apply the new values to the Y channel
-    for (auto& pixel : yuvImage) {
-        pixel.y = new_values[pixel.y];
+    for (auto& value : yPlane) {
+        value = new_values[value];
     }
 }
 
@@ -182,14 +234,14 @@ void clipHistogram(std::vector<int>& histogram, int clipLimit) {
 }
 
 // Sub-function: perform histogram equalization on a tile
-void equalizeHistogramTile(std::vector<YUV>& image, int width, int startX, int startY, int tileSizeX, int tileSizeY, int clipLimit) {
+void equalizeHistogramTile(std::vector<unsigned char>& image, int width, int startX, int startY, int tileSizeX, int tileSizeY, int clipLimit) {
     int endX = std::min(startX + tileSizeX, width);
     int endY = std::min(startY + tileSizeY, static_cast<int>(image.size() / width));
 
     std::vector<int> histogram(256, 0);
     for (int y = startY; y < endY; ++y) {
         for (int x = startX; x < endX; ++x) {
-            histogram[image[y * width + x].y]++;
+            histogram[image[y * width + x]]++;
         }
     }
 
@@ -213,13 +265,13 @@ void equalizeHistogramTile(std::vector<YUV>& image, int width, int startX, int s
     // apply the equalized histogram to the pixels
     for (int y = startY; y < endY; ++y) {
         for (int x = startX; x < endX; ++x) {
-            image[y * width + x].y = static_cast<unsigned char>(cdf[image[y * width + x].y]);
+            image[y * width + x] = static_cast<unsigned char>(cdf[image[y * width + x]]);
         }
     }
 }
 
 // Main CLAHE function with tile number
-void applyCLAHE(std::vector<YUV>& image, int width, int height, int numTilesX, int numTilesY, int clipLimit) {
+void applyCLAHE(std::vector<unsigned char>& image, int width, int height, int numTilesX, int numTilesY, int clipLimit) {
     // calculate tile size based on the number of tiles
     int tileSizeX = width / numTilesX;
     int tileSizeY = height / numTilesY;
@@ -232,6 +284,154 @@ void applyCLAHE(std::vector<YUV>& image, int width, int height, int numTilesX, i
     }
 }
 
+// Out-of-core CLAHE: same tiles and mapping as applyCLAHE, on a tiled copy of the Y plane
+void applyCLAHEOutOfCore(std::vector<unsigned char>& image, int width, int height, int numTilesX, int numTilesY, int clipLimit,
+                         const std::string& scratchPrefix) {
+    const std::string inputTiles = scratchPrefix + "_Y.tiles";
+    const std::string outputTiles = scratchPrefix + "_Y_CLAHE.tiles";
+    TiledImage input, output;
+    if (openTiledImage(input, inputTiles, width, height, 1, true) &&
+        openTiledImage(output, outputTiles, width, height, 1, true)) {
+        writeTiledRegion(input, 0, 0, width, height, image.data());
+        tiledCLAHE(input, output, numTilesX, numTilesY, clipLimit);
+        readTiledRegion(output, 0, 0, width, height, image.data());
+    }
+    closeTiledImage(input);
+    closeTiledImage(output);
+    std::remove(inputTiles.c_str());
+    std::remove(outputTiles.c_str());
+}
+
+
+// Sliding-window CLAHE =================================================================================================
+
+// Sub-function: clipped CDF of one value, with the same redistribution as clipHistogram
+// (excess / 256 to every bin, the remainder one each to the lowest bins)
+inline int clippedCDF(const int* histogram, int value, int clipLimit) {
+    int excess = 0;
+    int below = 0;
+    for (int i = 0; i < 256; ++i) {
+        int h = histogram[i];
+        int clipped = (clipLimit > 0 && h > clipLimit) ? clipLimit : h;
+        excess += h - clipped;
+        if (i <= value) {
+            below += clipped;
+        }
+    }
+    return below + (excess / 256) * (value + 1) + std::min(excess % 256, value + 1);
+}
+
+// Sub-function: equalize the rows [rowBegin, rowEnd) with per-pixel windows
+// column histograms cover the window rows; the window histogram slides one column per step
+void slidingWindowRows(const std::vector<unsigned char>& image, std::vector<unsigned char>& outputY,
+                       int width, int height, int radius, int clipLimit, int rowBegin, int rowEnd) {
+    // start from the window of row rowBegin - 1: the first step below removes its top row
+    std::vector<int> columnHistograms(width * 256, 0);
+    int windowTop = std::max(0, rowBegin - radius - 1);
+    int windowBottom = std::min(height - 1, rowBegin - 1 + radius);
+    for (int y = windowTop; y <= windowBottom; ++y) {
+        for (int x = 0; x < width; ++x) {
+            columnHistograms[x * 256 + image[y * width + x]]++;
+        }
+    }
+
+    int histogram[256];
+    for (int y = rowBegin; y < rowEnd; ++y) {
+        // move the column histograms down one row
+        int top = y - radius - 1;
+        int bottom = y + radius;
+        for (int x = 0; x < width; ++x) {
+            if (top >= 0) {
+                columnHistograms[x * 256 + image[top * width + x]]--;
+            }
+            if (bottom < height) {
+                columnHistograms[x * 256 + image[bottom * width + x]]++;
+            }
+        }
+        int rows = std::min(height - 1, y + radius) - std::max(0, y - radius) + 1;
+
+        // window histogram of the first pixel in the row
+        std::fill(histogram, histogram + 256, 0);
+        for (int x = 0; x <= std::min(radius, width - 1); ++x) {
+            const int* column = &columnHistograms[x * 256];
+            for (int i = 0; i < 256; ++i) {
+                histogram[i] += column[i];
+            }
+        }
+
+        for (int x = 0; x < width; ++x) {
+            if (x > 0) {
+                // add the entering column, remove the leaving one
+                if (x + radius < width) {
+                    const int* column = &columnHistograms[(x + radius) * 256];
+                    for (int i = 0; i < 256; ++i) {
+                        histogram[i] += column[i];
+                    }
+                }
+                if (x - radius - 1 >= 0) {
+                    const int* column = &columnHistograms[(x - radius - 1) * 256];
+                    for (int i = 0; i < 256; ++i) {
+                        histogram[i] -= column[i];
+                    }
+                }
+            }
+
+            int columns = std::min(width - 1, x + radius) - std::max(0, x - radius) + 1;
+            int total = rows * columns;
+            int value = image[y * width + x];
+            outputY[y * width + x] = static_cast<unsigned char>((clippedCDF(histogram, value, clipLimit) * 255) / total);
+        }
+    }
+}
+
+// Main sliding-window CLAHE: every pixel is mapped by the clipped CDF of its own window
+// (windowSize x windowSize, cropped at the borders); rows are split into numThreads bands,
+// one thread each (numThreads <= 0: one per core)
+void applySlidingWindowCLAHE(std::vector<unsigned char>& image, int width, int height, int windowSize, int clipLimit,
+                             int numThreads = 0) {
+    int radius = windowSize / 2;
+    std::vector<unsigned char> outputY(width * height);
+
+    if (numThreads <= 0) {
+        numThreads = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    numThreads = std::max(1, std::min(height, numThreads));
+    int rowsPerThread = (height + numThreads - 1) / numThreads;
+    std::vector<std::thread> workers;
+    for (int rowBegin = 0; rowBegin < height; rowBegin += rowsPerThread) {
+        int rowEnd = std::min(rowBegin + rowsPerThread, height);
+        workers.emplace_back(slidingWindowRows, std::cref(image), std::ref(outputY),
+                             width, height, radius, clipLimit, rowBegin, rowEnd);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    image.swap(outputY);
+}
+
+// Function: run the sliding-window CLAHE in `bands` row bands and in one, and return the
+// number of pixels that differ
+int checkSlidingWindowBands(const std::vector<unsigned char>& image, int width, int height, int windowSize,
+                            int clipLimit, int bands) {
+    std::vector<unsigned char> banded = image;
+    std::vector<unsigned char> single = image;
+    applySlidingWindowCLAHE(banded, width, height, windowSize, clipLimit, bands);
+    applySlidingWindowCLAHE(single, width, height, windowSize, clipLimit, 1);
+    int mismatches = 0;
+    for (size_t i = 0; i < banded.size(); ++i) {
+        mismatches += banded[i] != single[i];
+    }
+    return mismatches;
+}
+
+
+// Helper struct: one enhancement of the Y plane and the file its result goes to
+struct Enhancement {
+    std::string outputFile;
+    std::function<void(std::vector<unsigned char>&)> apply;
+    bool chained;   // sequential mode: continue from the previous enhancement's Y plane
+};
 
 int main() {
     // image dimensions
@@ -241,32 +441,76 @@ int main() {
     // input file path
     std::string inputFile = "./images/City.raw";  
 
-    // create a vector to store the YUV values
-    std::vector<YUV> yuvImage;
-
-    // transform RGB to YUV, and store in yuvImage
-    transformRGBToYUV(yuvImage, inputFile, width, height);
-
-    // apply transfer function to Y channel
-    transferFunctionYChannel(yuvImage, width, height);
-
-    // transform YUV to RGB, and store in rgbImage
-    transformYUVToRGB(yuvImage, "./outputs/CityDefogged_TF.raw");
-
-    // apply bucket filling to Y channel
-    bucketFillingYChannel(yuvImage, width, height);
-
-    // transform YUV to RGB, and store in rgbImage
-    transformYUVToRGB(yuvImage, "./outputs/CityDefogged_BF.raw");
+    // transform RGB to YUV once; every enhancement starts from these planes
+    YUVPlanes source;
+    if (!transformRGBToYUV(source, inputFile, width, height)) {
+        return 1;
+    }
 
-    // apply CLAHE
+    // CLAHE parameters
     int numTilesX = 4; // number of tiles in X direction
     int numTilesY = 4; // number of tiles in Y direction
     int clipLimit = 20; // contrast limit for histogram clipping
-    applyCLAHE(yuvImage, width, height, numTilesX, numTilesY, clipLimit);
 
-    // transform YUV to RGB, and store in rgbImage
-    transformYUVToRGB(yuvImage, "./outputs/CityDefogged_CLAHE.raw");
+    // sliding-window CLAHE parameters
+    int windowSize = 129; // per-pixel window, comparable to one 187x105 tile
+    int windowClipLimit = 20; // same absolute clip limit as the tiled version
+
+    std::vector<Enhancement> enhancements = {
+        {"./outputs/CityDefogged_TF.raw", [&](std::vector<unsigned char>& y) {
+            transferFunctionYChannel(y, width, height);
+        }, false},
+        {"./outputs/CityDefogged_BF.raw", [&](std::vector<unsigned char>& y) {
+            bucketFillingYChannel(y, width, height);
+        }, true},
+        {"./outputs/CityDefogged_CLAHE.raw", [&](std::vector<unsigned char>& y) {
+            if (OUT_OF_CORE_MODE) {
+                applyCLAHEOutOfCore(y, width, height, numTilesX, numTilesY, clipLimit, "./outputs/City");
+            } else {
+                applyCLAHE(y, width, height, numTilesX, numTilesY, clipLimit);
+            }
+        }, true},
+    };
+    if (SLIDING_WINDOW_CLAHE && SLIDING_WINDOW_CHECK) {
+        int mismatches = checkSlidingWindowBands(source.y, width, height, windowSize, windowClipLimit,
+                                                 SLIDING_WINDOW_CHECK_BANDS);
+        std::cout << "Sliding-window CLAHE in " << SLIDING_WINDOW_CHECK_BANDS << " bands vs one: "
+                  << mismatches << " pixels differ" << std::endl;
+        if (mismatches != 0) {
+            return 1;
+        }
+    }
+    if (SLIDING_WINDOW_CLAHE) {
+        enhancements.push_back({"./outputs/CityDefogged_SWCLAHE.raw", [&](std::vector<unsigned char>& y) {
+            applySlidingWindowCLAHE(y, width, height, windowSize, windowClipLimit);
+        }, false});
+    }
+
+    if (BRANCHING_MODE) {
+        // one branch per enhancement, each on its own copy of the source Y plane only
+        std::vector<std::thread> branches;
+        for (const Enhancement& enhancement : enhancements) {
+            branches.emplace_back([&source, &enhancement]() {
+                std::vector<unsigned char> y = source.y;
+                enhancement.apply(y);
+                transformYUVToRGB(y, source.u, source.v, enhancement.outputFile);
+            });
+        }
+        for (auto& branch : branches) {
+            branch.join();
+        }
+        return 0;
+    }
+
+    // sequential: a chained enhancement works on the previous one's result
+    std::vector<unsigned char> y;
+    for (const Enhancement& enhancement : enhancements) {
+        if (!enhancement.chained) {
+            y = source.y;
+        }
+        enhancement.apply(y);
+        transformYUVToRGB(y, source.u, source.v, enhancement.outputFile);
+    }
 
     return 0;
 }
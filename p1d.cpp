@@ -0,0 +1,220 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <string>
+
+#include "cpuDispatch.h"
+
+// Fused sensor-to-display pipeline: demosaic -> planar YUV -> CLAHE -> BGR
+//
+// The Bayer frame is demosaiced row by row straight into planar Y/U/V, and the CLAHE tile
+// histograms are accumulated as each row of tiles completes. Once the last row is in, the
+// clipped tile mappings are built and a single final pass maps Y and converts to BGR,
+// streaming rows to the output file. No full-size BGR or AoS YUV image is ever built.
+
+// Helper function: mirror an index into [0, size) keeping the Bayer parity
+inline int reflect(int index, int size) {
+    if (index < 0) {
+        return -index;
+    }
+    if (index >= size) {
+        return 2 * size - 2 - index;
+    }
+    return index;
+}
+
+// Helper function: clamp to the 8-bit range
+inline unsigned char clampByte(double value) {
+    return static_cast<unsigned char>(std::max(0.0, std::min(value, 255.0)));
+}
+
+// Function: bilinear demosaic of one row into B, G, R values. Bayer pattern of House.raw
+// (GRBG, checked against House_ori): green where x + y is even, red at even row / odd
+// column, blue at odd row / even column
+void demosaicRow(const std::vector<unsigned char>& rawData, int width, int height, int y,
+                 std::vector<int>& blue, std::vector<int>& green, std::vector<int>& red) {
+    const unsigned char* up = &rawData[reflect(y - 1, height) * width];
+    const unsigned char* row = &rawData[y * width];
+    const unsigned char* down = &rawData[reflect(y + 1, height) * width];
+
+    // interior columns through the dispatched kernel; the two border columns reflect
+    cpuKernels().demosaicRow(up, row, down, y % 2, 1, width - 1, blue.data(), green.data(), red.data());
+    for (int x : {0, width - 1}) {
+        int left = reflect(x - 1, width);
+        int right = reflect(x + 1, width);
+        int cross = (up[x] + down[x] + row[left] + row[right] + 2) / 4;
+        int diagonal = (up[left] + up[right] + down[left] + down[right] + 2) / 4;
+        int horizontal = (row[left] + row[right] + 1) / 2;
+        int vertical = (up[x] + down[x] + 1) / 2;
+
+        if (y % 2 == 0 && x % 2 == 1) {
+            // red site
+            red[x] = row[x];
+            green[x] = cross;
+            blue[x] = diagonal;
+        } else if (y % 2 == 1 && x % 2 == 0) {
+            // blue site
+            blue[x] = row[x];
+            green[x] = cross;
+            red[x] = diagonal;
+        } else if (y % 2 == 0) {
+            // green site on a red row
+            green[x] = row[x];
+            red[x] = horizontal;
+            blue[x] = vertical;
+        } else {
+            // green site on a blue row
+            green[x] = row[x];
+            blue[x] = horizontal;
+            red[x] = vertical;
+        }
+    }
+}
+
+// Sub-function: clip the histogram (same redistribution as p1c)
+void clipHistogram(std::vector<int>& histogram, int clipLimit) {
+    int excess = 0;
+    for (auto& h : histogram) {
+        if (h > clipLimit) {
+            excess += h - clipLimit;
+            h = clipLimit;
+        }
+    }
+
+    int increment = excess / histogram.size();
+    int residual = excess % histogram.size();
+
+    for (auto& h : histogram) {
+        h += increment;
+        if (residual > 0) {
+            h++;
+            residual--;
+        }
+    }
+}
+
+// Function: fused demosaic + CLAHE, writes a BGR raw file
+bool fusedDemosaicCLAHE(const std::vector<unsigned char>& rawData,
+                        int width,
+                        int height,
+                        int numTilesX,
+                        int numTilesY,
+                        int clipLimit,
+                        const std::string& outputFile) {
+    // tiling identical to p1c applyCLAHE (a short remainder tile where the size does not divide)
+    int tileSizeX = width / numTilesX;
+    int tileSizeY = height / numTilesY;
+    int tilesX = (width + tileSizeX - 1) / tileSizeX;
+    int tilesY = (height + tileSizeY - 1) / tileSizeY;
+    std::vector<std::vector<int> > histograms(tilesX * tilesY, std::vector<int>(256, 0));
+
+    // the only full-size buffers: the three planes
+    std::vector<unsigned char> yPlane(width * height);
+    std::vector<unsigned char> uPlane(width * height);
+    std::vector<unsigned char> vPlane(width * height);
+    std::vector<int> blue(width), green(width), red(width);
+
+    // pass 1: demosaic row by row into planar YUV, accumulating tile histograms
+    const CpuKernels& kernels = cpuKernels();
+    for (int y = 0; y < height; ++y) {
+        demosaicRow(rawData, width, height, y, blue, green, red);
+        kernels.bgrToYuvRow(blue.data(), green.data(), red.data(), width,
+                            &yPlane[y * width], &uPlane[y * width], &vPlane[y * width]);
+
+        // a row of tiles is complete: histogram each tile in one call
+        if ((y + 1) % tileSizeY == 0 || y + 1 == height) {
+            int tileY = y / tileSizeY;
+            int startY = tileY * tileSizeY;
+            for (int tileX = 0; tileX < tilesX; ++tileX) {
+                int startX = tileX * tileSizeX;
+                kernels.histogram(&yPlane[startY * width + startX], std::min(tileSizeX, width - startX),
+                                  y + 1 - startY, width, histograms[tileY * tilesX + tileX].data());
+            }
+        }
+    }
+
+    // tile mappings: clipped, normalized CDF per tile
+    std::vector<std::vector<unsigned char> > mappings(tilesX * tilesY, std::vector<unsigned char>(256));
+    for (size_t t = 0; t < histograms.size(); ++t) {
+        std::vector<int>& histogram = histograms[t];
+        if (clipLimit > 0) {
+            clipHistogram(histogram, clipLimit);
+        }
+
+        int cdf = 0;
+        int total = 0;
+        for (int h : histogram) {
+            total += h;
+        }
+        for (int i = 0; i < 256; ++i) {
+            cdf += histogram[i];
+            mappings[t][i] = static_cast<unsigned char>(total > 0 ? (cdf * 255) / total : i);
+        }
+    }
+
+    std::ofstream outFile(outputFile, std::ios::binary);
+    if (!outFile.is_open()) {
+        std::cerr << "Unable to open file for enhanced image: " << outputFile << std::endl;
+        return false;
+    }
+
+    // pass 2: map Y and convert to BGR, one row at a time
+    std::vector<unsigned char> bgrRow(width * 3);
+    std::vector<unsigned char> lumaRow(width);
+    for (int y = 0; y < height; ++y) {
+        const std::vector<unsigned char>* mappingRow = &mappings[(y / tileSizeY) * tilesX];
+        for (int tileX = 0; tileX < tilesX; ++tileX) {
+            int startX = tileX * tileSizeX;
+            kernels.applyLut(&yPlane[y * width + startX], &lumaRow[startX], std::min(tileSizeX, width - startX),
+                             mappingRow[tileX].data());
+        }
+        for (int x = 0; x < width; ++x) {
+            int index = y * width + x;
+            double luma = lumaRow[x];
+            double u = uPlane[index] - 128.0;
+            double v = vPlane[index] - 128.0;
+            bgrRow[3 * x] = clampByte(luma + 2.03211 * u);
+            bgrRow[3 * x + 1] = clampByte(luma - 0.39465 * u - 0.58060 * v);
+            bgrRow[3 * x + 2] = clampByte(luma + 1.13983 * v);
+        }
+        outFile.write(reinterpret_cast<const char*>(bgrRow.data()), bgrRow.size());
+    }
+
+    if (!outFile.good()) {
+        std::cerr << "Error occurred at writing time!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    // initialize variables
+    const std::string houseFilename = "./images/House.raw";
+    const std::string outputFilename = "./outputs/House_CLAHE.raw";
+    const int width = 420;
+    const int height = 288;
+
+    // open the raw file
+    std::ifstream file(houseFilename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error opening file!" << std::endl;
+        return 1; // Error code
+    }
+
+    // read the raw data
+    std::vector<unsigned char> rawData(width * height);
+    file.read(reinterpret_cast<char*>(rawData.data()), rawData.size());
+    file.close();
+
+    // CLAHE parameters, as in p1c
+    int numTilesX = 4;
+    int numTilesY = 4;
+    int clipLimit = 20;
+
+    if (!fusedDemosaicCLAHE(rawData, width, height, numTilesX, numTilesY, clipLimit, outputFilename)) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -6,6 +6,8 @@
 #include <fstream>
 #include <iostream>
 
+#include "cpuDispatch.h"
+
 // image dimensions
 const int WIDTH = 768; 
 const int HEIGHT = 512; 
@@ -35,10 +37,8 @@ double calculateMSE(const std::vector<unsigned char>& original,
         throw std::invalid_argument("Images must have the same size for MSE calculation.");
     }
 
-    double mse = 0.0;
-    for (size_t i = 0; i < original.size(); ++i) {
-        mse += std::pow(original[i] - denoised[i], 2);
-    }
+    // the exact integer sum, through the widest SIMD level of the host
+    double mse = static_cast<double>(cpuKernels().sumSquaredDifferences(original.data(), denoised.data(), original.size()));
     mse /= (width * height);
     return mse;
 }
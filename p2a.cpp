@@ -1,13 +1,36 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <string>
+#include <cstdio>
+
+#include "fftConvolution.h"
+#include "fixedPointConvolution.h"
+#include "autoTuner.h"
+#include "recursiveGaussian.h"
+#include "tiledImage.h"
 
 // image dimensions
 const int WIDTH = 768; 
 const int HEIGHT = 512; 
 
+// sigma at or above which applyGaussianFilter switches to the recursive (IIR) Gaussian
+const double RECURSIVE_GAUSSIAN_SIGMA = 4.0;
+
+// fixed-point mode: small kernels run with integer weights and SIMD integer accumulators
+// (within one gray level of the double loops; the uniform filter stays exact)
+const bool FIXED_POINT_MODE = false;
+
+// auto-tuning: time the Gaussian variants and FFT tile sizes once per host and shape, and
+// reuse the winners from AUTO_TUNE_FILE on later runs (otherwise the measured crossovers)
+const bool AUTO_TUNE = true;
+
+// out-of-core mode: stream the image through tiled files (tiledImage.h) and filter it block
+// by block, so only the tile caches live in memory (for images that do not fit in RAM)
+const bool OUT_OF_CORE_MODE = false;
+
 // Helper function: read RAW image data
 std::vector<unsigned char> readRawImage(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary);
@@ -31,11 +54,48 @@ void writeRawImage(const std::string& filename,
     file.write(reinterpret_cast<const char*>(&image_data[0]), image_data.size() * sizeof(unsigned char));
 }
 
+// Helper function: fixed-point kernel over the interior (where the kernel fits in the image);
+// rows holds kernel.height pointers
+void convolveFixedPointInterior(const FixedPointKernel& kernel,
+                                const std::vector<unsigned char>& input,
+                                std::vector<unsigned char>& output,
+                                const unsigned char** rows) {
+    int offsetX = kernel.width / 2;
+    int offsetY = kernel.height / 2;
+    for (int y = offsetY; y < HEIGHT - offsetY; ++y) {
+        for (int r = 0; r < kernel.height; ++r) {
+            rows[r] = &input[(y - offsetY + r) * WIDTH];
+        }
+        convolveFixedPointRow(kernel, rows, 1, WIDTH - 2 * offsetX, &output[y * WIDTH + offsetX]);
+    }
+}
+
 // Function: uniform weight filter to the image
+// (large kernels go through the FFT engine; the sums are integers, so the result is the same)
 void applyUniformFilter(const std::vector<unsigned char>& input, 
                         std::vector<unsigned char>& output, 
                         int kernelSize) {
     int offset = kernelSize / 2;
+    if (FIXED_POINT_MODE && useFixedPointConvolution(kernelSize, kernelSize)) {
+        FixedPointKernel box = createFixedPointBoxKernel(kernelSize, kernelSize);
+        std::vector<const unsigned char*> rows(kernelSize);
+        convolveFixedPointInterior(box, input, output, rows.data());
+        return;
+    }
+    if (useFFTConvolution(kernelSize, kernelSize)) {
+        std::vector<double> ones(kernelSize * kernelSize, 1.0);
+        FFTConvolutionPlan fftPlan = createFFTConvolutionPlan(ones, kernelSize, kernelSize, WIDTH, HEIGHT);
+        std::vector<double> sums(WIDTH * HEIGHT);
+        executeFFTConvolution(fftPlan, input.data(), WIDTH, HEIGHT, 1, sums.data());
+        for (int y = offset; y < HEIGHT - offset; ++y) {
+            for (int x = offset; x < WIDTH - offset; ++x) {
+                int sum = static_cast<int>(std::lround(sums[y * WIDTH + x]));
+                output[y * WIDTH + x] = sum / (kernelSize * kernelSize);
+            }
+        }
+        return;
+    }
+
     for (int y = offset; y < HEIGHT - offset; ++y) {
         for (int x = offset; x < WIDTH - offset; ++x) {
             int sum = 0;
@@ -49,53 +109,331 @@ void applyUniformFilter(const std::vector<unsigned char>& input,
     }
 }
 
+// Function: filter the image with an arbitrary kernelWidth x kernelHeight kernel (row-major,
+// applied as a correlation, e.g. a measured PSF); direct or FFT depending on the kernel area
+void applyKernelFilter(const std::vector<unsigned char>& input,
+                       std::vector<unsigned char>& output,
+                       const std::vector<double>& kernel,
+                       int kernelWidth,
+                       int kernelHeight) {
+    int offsetX = kernelWidth / 2;
+    int offsetY = kernelHeight / 2;
+    if (FIXED_POINT_MODE && useFixedPointConvolution(kernelWidth, kernelHeight)) {
+        FixedPointKernel fixed = createFixedPointKernel(kernel, kernelWidth, kernelHeight);
+        std::vector<const unsigned char*> rows(kernelHeight);
+        convolveFixedPointInterior(fixed, input, output, rows.data());
+        return;
+    }
+    if (useFFTConvolution(kernelWidth, kernelHeight)) {
+        FFTConvolutionPlan fftPlan = createFFTConvolutionPlan(kernel, kernelWidth, kernelHeight, WIDTH, HEIGHT);
+        std::vector<double> sums(WIDTH * HEIGHT);
+        executeFFTConvolution(fftPlan, input.data(), WIDTH, HEIGHT, 1, sums.data());
+        for (int y = offsetY; y < HEIGHT - offsetY; ++y) {
+            for (int x = offsetX; x < WIDTH - offsetX; ++x) {
+                output[y * WIDTH + x] = static_cast<unsigned char>(std::max(0.0, std::min(sums[y * WIDTH + x], 255.0)));
+            }
+        }
+        return;
+    }
+
+    for (int y = offsetY; y < HEIGHT - offsetY; ++y) {
+        for (int x = offsetX; x < WIDTH - offsetX; ++x) {
+            double sum = 0;
+            for (int dy = -offsetY; dy <= offsetY; ++dy) {
+                for (int dx = -offsetX; dx <= offsetX; ++dx) {
+                    sum += input[(y + dy) * WIDTH + (x + dx)] * kernel[(dy + offsetY) * kernelWidth + (dx + offsetX)];
+                }
+            }
+            output[y * WIDTH + x] = static_cast<unsigned char>(std::max(0.0, std::min(sum, 255.0)));
+        }
+    }
+}
+
 // Helper function: calculate Gaussian weight
 double gaussian(double x, double y, double sigma) {
     return exp(-(x * x + y * y) / (2 * sigma * sigma)) / (2 * M_PI * sigma * sigma);
 }
 
-// Function: Gaussian filter to the image
-void applyGaussianFilter(const std::vector<unsigned char>& input, 
-                         std::vector<unsigned char>& output, 
-                         int kernelSize, 
-                         double sigma) {
+// Gaussian filter implementations; GAUSSIAN_AUTO lets chooseGaussianVariant pick one
+enum GaussianVariant {
+    GAUSSIAN_AUTO,
+    GAUSSIAN_DIRECT,
+    GAUSSIAN_FIXED_POINT,
+    GAUSSIAN_FFT,
+    GAUSSIAN_RECURSIVE
+};
+
+// Plan: the kernel, IIR coefficients and work buffers of applyGaussianFilter, built once for
+// the image shape and (kernel size, sigma); executing it allocates nothing
+struct GaussianFilterPlan {
+    int width;
+    int height;
+    int kernelSize;
+    double sigma;
+    GaussianVariant variant;                   // the implementation this plan runs (never AUTO)
+    std::vector<double> kernel;                // normalized kernel (direct and FFT paths)
+    FixedPointKernel fixedKernel;              // Q-format weights (fixed-point path)
+    std::vector<const unsigned char*> rowPointers; // input rows under the kernel (fixed-point path)
+    RecursiveGaussianCoefficients coefficients; // recursive path
+    std::vector<float> scratch;                // image-sized working copy (recursive path)
+    std::vector<float> columnState;            // three rows of column-pass state (recursive path)
+    FFTConvolutionPlan fftPlan;                // cached kernel spectrum and tiles (FFT path)
+    std::vector<double> fftOutput;             // image-sized result (FFT path)
+};
+
+GaussianVariant chooseGaussianVariant(int kernelSize, double sigma);
+
+// Function: build a Gaussian filter plan (GAUSSIAN_AUTO: recursive for large sigmas, otherwise
+// the auto-tuned or crossover choice)
+GaussianFilterPlan createGaussianFilterPlan(int kernelSize, double sigma, GaussianVariant variant = GAUSSIAN_AUTO) {
+    GaussianFilterPlan plan;
+    plan.width = WIDTH;
+    plan.height = HEIGHT;
+    plan.kernelSize = kernelSize;
+    plan.sigma = sigma;
+    plan.variant = (variant == GAUSSIAN_AUTO) ? chooseGaussianVariant(kernelSize, sigma) : variant;
+
+    if (plan.variant == GAUSSIAN_RECURSIVE) {
+        // unlike the direct filter, the recursive one also covers the border rows and columns
+        plan.coefficients = computeRecursiveGaussianCoefficients(sigma);
+        plan.scratch.resize(plan.width * plan.height);
+        plan.columnState.resize(3 * plan.width);
+        return plan;
+    }
+
     int offset = kernelSize / 2;
-    std::vector<double> kernel(kernelSize * kernelSize);
+    plan.kernel.resize(kernelSize * kernelSize);
     double sumKernel = 0;
 
     // create the Gaussian kernel
     for (int y = -offset; y <= offset; ++y) {
         for (int x = -offset; x <= offset; ++x) {
-            kernel[(y + offset) * kernelSize + (x + offset)] = gaussian(x, y, sigma);
-            sumKernel += kernel[(y + offset) * kernelSize + (x + offset)];
+            plan.kernel[(y + offset) * kernelSize + (x + offset)] = gaussian(x, y, sigma);
+            sumKernel += plan.kernel[(y + offset) * kernelSize + (x + offset)];
         }
     }
 
     // normalize the kernel
-    for (double &value : kernel) {
+    for (double &value : plan.kernel) {
         value /= sumKernel;
     }
 
+    if (plan.variant == GAUSSIAN_FIXED_POINT) {
+        plan.fixedKernel = createFixedPointKernel(plan.kernel, kernelSize, kernelSize);
+        plan.rowPointers.resize(kernelSize);
+    }
+    if (plan.variant == GAUSSIAN_FFT) {
+        // tile size tuned only for the plans actually used, not the candidates being timed
+        int tileSize = (AUTO_TUNE && variant == GAUSSIAN_AUTO)
+            ? tunedFFTTileSize(plan.kernel, kernelSize, kernelSize, plan.width, plan.height) : 0;
+        plan.fftPlan = createFFTConvolutionPlan(plan.kernel, kernelSize, kernelSize, plan.width, plan.height, tileSize);
+        plan.fftOutput.resize(plan.width * plan.height);
+    }
+
+    return plan;
+}
+
+// Function: run a Gaussian filter plan; output must already hold width * height pixels
+void executeGaussianFilterPlan(GaussianFilterPlan& plan,
+                               const std::vector<unsigned char>& input,
+                               std::vector<unsigned char>& output) {
+    const int width = plan.width;
+    const int height = plan.height;
+
+    if (plan.variant == GAUSSIAN_RECURSIVE) {
+        recursiveGaussianImage(plan.coefficients, input.data(), width, height, 1,
+                               plan.scratch.data(), plan.columnState.data(), output.data());
+        return;
+    }
+
+    const int kernelSize = plan.kernelSize;
+    const int offset = kernelSize / 2;
+    const std::vector<double>& kernel = plan.kernel;
+
+    if (plan.variant == GAUSSIAN_FIXED_POINT) {
+        convolveFixedPointInterior(plan.fixedKernel, input, output, plan.rowPointers.data());
+        return;
+    }
+
+    if (plan.variant == GAUSSIAN_FFT) {
+        // same interior as the direct loops
+        executeFFTConvolution(plan.fftPlan, input.data(), width, height, 1, plan.fftOutput.data());
+        for (int y = offset; y < height - offset; ++y) {
+            for (int x = offset; x < width - offset; ++x) {
+                output[y * width + x] = static_cast<unsigned char>(std::max(0.0, std::min(plan.fftOutput[y * width + x], 255.0)));
+            }
+        }
+        return;
+    }
+
     // apply the Gaussian kernel to the image
-    for (int y = offset; y < HEIGHT - offset; ++y) {
-        for (int x = offset; x < WIDTH - offset; ++x) {
+    for (int y = offset; y < height - offset; ++y) {
+        for (int x = offset; x < width - offset; ++x) {
             double sum = 0;
             for (int dy = -offset; dy <= offset; ++dy) {
                 for (int dx = -offset; dx <= offset; ++dx) {
-                    sum += input[(y + dy) * WIDTH + (x + dx)] * kernel[(dy + offset) * kernelSize + (dx + offset)];
+                    sum += input[(y + dy) * width + (x + dx)] * kernel[(dy + offset) * kernelSize + (dx + offset)];
                 }
             }
-            output[y * WIDTH + x] = static_cast<unsigned char>(sum);
+            output[y * width + x] = static_cast<unsigned char>(sum);
         }
     }
 }
 
+// Function: pick the Gaussian implementation for a plan. Large sigmas take the recursive filter
+// (an accuracy choice, see RECURSIVE_GAUSSIAN_SIGMA). Otherwise the auto-tuner times the
+// candidates near the measured crossovers on a noise image of the real shape (sigma does not
+// change the cost, so it is not part of the key).
+GaussianVariant chooseGaussianVariant(int kernelSize, double sigma) {
+    if (sigma >= RECURSIVE_GAUSSIAN_SIGMA) {
+        return GAUSSIAN_RECURSIVE;
+    }
+    const int taps = kernelSize * kernelSize;
+    const bool fixedPoint = FIXED_POINT_MODE && useFixedPointConvolution(kernelSize, kernelSize);
+    if (!AUTO_TUNE) {
+        if (fixedPoint) {
+            return GAUSSIAN_FIXED_POINT;
+        }
+        return useFFTConvolution(kernelSize, kernelSize) ? GAUSSIAN_FFT : GAUSSIAN_DIRECT;
+    }
+
+    // far from the crossover the slow side is not worth timing
+    std::vector<std::string> candidates;
+    if (taps <= 4 * FFT_CONVOLUTION_MIN_TAPS) {
+        candidates.push_back("direct");
+    }
+    if (fixedPoint) {
+        candidates.push_back("fixed-point");
+    }
+    if (4 * taps >= FFT_CONVOLUTION_MIN_TAPS) {
+        candidates.push_back("fft");
+    }
+
+    std::vector<unsigned char> image = benchmarkImage(static_cast<size_t>(WIDTH) * HEIGHT);
+    std::vector<unsigned char> output(image.size());
+    std::string shape = shapeKey(WIDTH, HEIGHT, 1) + " k" + std::to_string(kernelSize);
+    std::string best = autoTune("gaussian", shape, candidates, [&](const std::string& candidate) {
+        GaussianVariant forced = (candidate == "fft") ? GAUSSIAN_FFT
+                               : (candidate == "fixed-point") ? GAUSSIAN_FIXED_POINT : GAUSSIAN_DIRECT;
+        GaussianFilterPlan plan = createGaussianFilterPlan(kernelSize, sigma, forced);
+        executeGaussianFilterPlan(plan, image, output);
+    });
+    return (best == "fft") ? GAUSSIAN_FFT : (best == "fixed-point") ? GAUSSIAN_FIXED_POINT : GAUSSIAN_DIRECT;
+}
+
+// Function: Gaussian filter to the image (a one-off plan; reuse a plan for batches)
+void applyGaussianFilter(const std::vector<unsigned char>& input, 
+                         std::vector<unsigned char>& output, 
+                         int kernelSize, 
+                         double sigma) {
+    GaussianFilterPlan plan = createGaussianFilterPlan(kernelSize, sigma);
+    executeGaussianFilterPlan(plan, input, output);
+}
+
+// Function: uniform filter of one tiled block (same interior and rounding as applyUniformFilter)
+void uniformFilterBlock(const TiledBlock& block, int kernelSize) {
+    const int offset = kernelSize / 2;
+    const int inputWidth = block.width + 2 * block.halo;
+    for (int y = 0; y < block.height; ++y) {
+        int64_t imageY = block.y + y;
+        if (imageY < offset || imageY >= block.imageHeight - offset) {
+            continue;
+        }
+        for (int x = 0; x < block.width; ++x) {
+            int64_t imageX = block.x + x;
+            if (imageX < offset || imageX >= block.imageWidth - offset) {
+                continue;
+            }
+            int sum = 0;
+            for (int dy = -offset; dy <= offset; ++dy) {
+                const unsigned char* row = &block.input[static_cast<size_t>(y + block.halo + dy) * inputWidth + x + block.halo];
+                for (int dx = -offset; dx <= offset; ++dx) {
+                    sum += row[dx];
+                }
+            }
+            block.output[static_cast<size_t>(y) * block.width + x] = sum / (kernelSize * kernelSize);
+        }
+    }
+}
+
+// Function: kernel filter of one tiled block (same interior and truncation as the direct
+// Gaussian loops)
+void kernelFilterBlock(const TiledBlock& block, const std::vector<double>& kernel, int kernelSize) {
+    const int offset = kernelSize / 2;
+    const int inputWidth = block.width + 2 * block.halo;
+    for (int y = 0; y < block.height; ++y) {
+        int64_t imageY = block.y + y;
+        if (imageY < offset || imageY >= block.imageHeight - offset) {
+            continue;
+        }
+        for (int x = 0; x < block.width; ++x) {
+            int64_t imageX = block.x + x;
+            if (imageX < offset || imageX >= block.imageWidth - offset) {
+                continue;
+            }
+            double sum = 0;
+            for (int dy = -offset; dy <= offset; ++dy) {
+                const unsigned char* row = &block.input[static_cast<size_t>(y + block.halo + dy) * inputWidth + x + block.halo];
+                for (int dx = -offset; dx <= offset; ++dx) {
+                    sum += row[dx] * kernel[(dy + offset) * kernelSize + (dx + offset)];
+                }
+            }
+            block.output[static_cast<size_t>(y) * block.width + x] = static_cast<unsigned char>(sum);
+        }
+    }
+}
+
+// Function: the uniform and Gaussian filters out of core: raw file -> tiled input -> tiled
+// outputs -> raw files, with only the tile caches in memory
+bool filterOutOfCore(const std::string& inputFilename,
+                     const std::string& uniformOutputFilename,
+                     const std::string& gaussianOutputFilename,
+                     int uniformKernelSize,
+                     int gaussianKernelSize,
+                     double gaussianSigma) {
+    const std::string inputTiles = uniformOutputFilename + ".input.tiles";
+    const std::string uniformTiles = uniformOutputFilename + ".tiles";
+    const std::string gaussianTiles = gaussianOutputFilename + ".tiles";
+    TiledImage input, uniform, gaussianImage;
+    bool ok = openTiledImage(input, inputTiles, WIDTH, HEIGHT, 1, true) &&
+              openTiledImage(uniform, uniformTiles, WIDTH, HEIGHT, 1, true) &&
+              openTiledImage(gaussianImage, gaussianTiles, WIDTH, HEIGHT, 1, true) &&
+              importRawToTiled(inputFilename, input);
+
+    if (ok) {
+        applyTiledStencil(input, uniform, uniformKernelSize / 2, [&](const TiledBlock& block) {
+            uniformFilterBlock(block, uniformKernelSize);
+        });
+        std::vector<double> kernel = createGaussianFilterPlan(gaussianKernelSize, gaussianSigma, GAUSSIAN_DIRECT).kernel;
+        applyTiledStencil(input, gaussianImage, gaussianKernelSize / 2, [&](const TiledBlock& block) {
+            kernelFilterBlock(block, kernel, gaussianKernelSize);
+        });
+        ok = exportTiledToRaw(uniform, uniformOutputFilename) && exportTiledToRaw(gaussianImage, gaussianOutputFilename);
+    }
+
+    closeTiledImage(input);
+    closeTiledImage(uniform);
+    closeTiledImage(gaussianImage);
+    std::remove(inputTiles.c_str());
+    std::remove(uniformTiles.c_str());
+    std::remove(gaussianTiles.c_str());
+    return ok;
+}
 
 int main() {
     std::string inputFilename = "./images/Flower_gray_noisy.raw";
     std::string uniformOutputFilename = "./outputs/Flower_gray_uniform.raw";
     std::string gaussianOutputFilename = "./outputs/Flower_gray_gaussian.raw";
 
+    if (OUT_OF_CORE_MODE) {
+        // same filters as below (kernel size 3, Gaussian sigma 1.0)
+        if (!filterOutOfCore(inputFilename, uniformOutputFilename, gaussianOutputFilename, 3, 3, 1.0)) {
+            return 1;
+        }
+        std::cout << "Filtering completed." << std::endl;
+        return 0;
+    }
+
     std::vector<unsigned char> image_data = readRawImage(inputFilename);
     std::vector<unsigned char> uniform_filtered_image(WIDTH * HEIGHT);
     std::vector<unsigned char> gaussian_filtered_image(WIDTH * HEIGHT);
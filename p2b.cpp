@@ -3,11 +3,27 @@
 #include <vector>
 #include <cmath>
 #include <string>
+#include <algorithm>
+
+#include "guidedFilter.h"
+#include "adaptiveDenoise.h"
 
 // image dimensions
 const int WIDTH = 768; 
 const int HEIGHT = 512; 
 
+// guided filter mode: replace the O(r^2) bilateral filter with the O(1) self-guided filter
+// (radius filterSize / 2, eps = sigmaI^2); a little different in character, much faster
+const bool GUIDED_FILTER_MODE = false;
+
+// adaptive mode: a box mean (radius ADAPTIVE_SMOOTH_RADIUS) on flat tiles and the bilateral
+// filter only on tiles whose smoothed variance exceeds ADAPTIVE_THRESHOLD (bit-identical there),
+// ramped into the flat tiles next to them (adaptiveDenoise.h)
+const bool ADAPTIVE_MODE = false;
+const int ADAPTIVE_TILE_SIZE = 16;
+const double ADAPTIVE_THRESHOLD = 32.0;
+const int ADAPTIVE_SMOOTH_RADIUS = 2;
+
 // Helper function: read RAW image data
 std::vector<unsigned char> readRawImage(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary);
@@ -36,53 +52,129 @@ inline unsigned char clamp(int value, int low, int high) {
     return static_cast<unsigned char>(std::max(low, std::min(value, high)));
 }
 
-// Function: bilateral filter
-void bilateralFilter(const std::vector<unsigned char>& flatImage,
-                     std::vector<unsigned char>& filteredImage,
-                     int filterSize,
-                     double sigmaI,
-                     double sigmaS) {
+// Plan: domain weights and the range-weight table of bilateralFilter, built once for the
+// image shape and parameters; executing it allocates nothing
+struct BilateralFilterPlan {
+    int width;
+    int height;
+    int filterSize;
+    double sigmaI;
+    double sigmaS;
+    std::vector<double> gaussianDomain; // filterSize x filterSize, row-major
+    double rangeKernel[256];            // indexed by |center - neighbor|
+};
+
+// Function: build a bilateral filter plan
+BilateralFilterPlan createBilateralFilterPlan(int filterSize, double sigmaI, double sigmaS) {
+    BilateralFilterPlan plan;
+    plan.width = WIDTH;
+    plan.height = HEIGHT;
+    plan.filterSize = filterSize;
+    plan.sigmaI = sigmaI;
+    plan.sigmaS = sigmaS;
+
     // precompute Gaussian domain weights
     double twoSigmaS2 = 2.0 * sigmaS * sigmaS;
     double twoSigmaI2 = 2.0 * sigmaI * sigmaI;
-    std::vector< std::vector<double> > gaussianDomain(filterSize, std::vector<double>(filterSize));
     int halfFilterSize = filterSize / 2;
-
+    plan.gaussianDomain.resize(filterSize * filterSize);
     for (int i = -halfFilterSize; i <= halfFilterSize; ++i) {
         for (int j = -halfFilterSize; j <= halfFilterSize; ++j) {
-            gaussianDomain[i + halfFilterSize][j + halfFilterSize] = exp(-(i * i + j * j) / twoSigmaS2);
+            plan.gaussianDomain[(i + halfFilterSize) * filterSize + (j + halfFilterSize)] = exp(-(i * i + j * j) / twoSigmaS2);
         }
     }
 
+    // precompute range weights for every possible 8-bit difference
+    for (int d = 0; d < 256; ++d) {
+        plan.rangeKernel[d] = exp(-pow(static_cast<double>(d), 2) / twoSigmaI2);
+    }
+
+    return plan;
+}
+
+// Function: run a bilateral filter plan over rows [rowBegin, rowEnd) x columns [colBegin, colEnd)
+// (neighbors outside the rectangle are read from the whole image)
+void executeBilateralFilterRegion(const BilateralFilterPlan& plan,
+                                  const std::vector<unsigned char>& flatImage,
+                                  std::vector<unsigned char>& filteredImage,
+                                  int rowBegin, int rowEnd, int colBegin, int colEnd) {
+    const int width = plan.width;
+    const int height = plan.height;
+    const int filterSize = plan.filterSize;
+    const int halfFilterSize = filterSize / 2;
+
     // apply the filter to each pixel
-    for (int i = 0; i < HEIGHT; ++i) {
-        for (int j = 0; j < WIDTH; ++j) {
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        for (int j = colBegin; j < colEnd; ++j) {
             double sumWeights = 0.0;
             double sumFilteredPixel = 0.0;
+            int center = flatImage[i * width + j];
             
             for (int fi = -halfFilterSize; fi <= halfFilterSize; ++fi) {
-                for (int fj = -halfFilterSize; fj <= halfFilterSize; ++fj) {
-                    int ni = i + fi;
-                    int nj = j + fj;
+                // Mirror boundaries
+                int ni = std::max(0, std::min(i + fi, height - 1));
+                const double* domainRow = &plan.gaussianDomain[(fi + halfFilterSize) * filterSize];
 
-                    // Mirror boundaries
-                    ni = std::max(0, std::min(ni, HEIGHT - 1));
-                    nj = std::max(0, std::min(nj, WIDTH - 1));
+                for (int fj = -halfFilterSize; fj <= halfFilterSize; ++fj) {
+                    int nj = std::max(0, std::min(j + fj, width - 1));
+                    int neighbor = flatImage[ni * width + nj];
 
-                    double rangeKernel = exp(-pow(static_cast<double>(flatImage[i * WIDTH + j]) - flatImage[ni * WIDTH + nj], 2) / twoSigmaI2);
-                    double weight = gaussianDomain[fi + halfFilterSize][fj + halfFilterSize] * rangeKernel;
+                    double weight = domainRow[fj + halfFilterSize] * plan.rangeKernel[std::abs(center - neighbor)];
 
                     sumWeights += weight;
-                    sumFilteredPixel += flatImage[ni * WIDTH + nj] * weight;
+                    sumFilteredPixel += neighbor * weight;
                 }
             }
 
-            filteredImage[i * WIDTH + j] = clamp(static_cast<int>(sumFilteredPixel / sumWeights), 0, 255);
+            filteredImage[i * width + j] = clamp(static_cast<int>(sumFilteredPixel / sumWeights), 0, 255);
         }
     }
 }
 
+// Function: run a bilateral filter plan; filteredImage must already hold width * height pixels
+void executeBilateralFilterPlan(const BilateralFilterPlan& plan,
+                                const std::vector<unsigned char>& flatImage,
+                                std::vector<unsigned char>& filteredImage) {
+    executeBilateralFilterRegion(plan, flatImage, filteredImage, 0, plan.height, 0, plan.width);
+}
+
+// Function: bilateral filter (a one-off plan; reuse a plan for batches)
+void bilateralFilter(const std::vector<unsigned char>& flatImage,
+                     std::vector<unsigned char>& filteredImage,
+                     int filterSize,
+                     double sigmaI,
+                     double sigmaS) {
+    BilateralFilterPlan plan = createBilateralFilterPlan(filterSize, sigmaI, sigmaS);
+    executeBilateralFilterPlan(plan, flatImage, filteredImage);
+}
+
+// Function: self-guided filter, the drop-in alternative to bilateralFilter (a one-off plan)
+void guidedFilter(const std::vector<unsigned char>& flatImage,
+                  std::vector<unsigned char>& filteredImage,
+                  int radius,
+                  double eps) {
+    GuidedFilterPlan plan = createGuidedFilterPlan(WIDTH, HEIGHT, 1, 1, radius, eps);
+    executeGuidedFilterPlan(plan, flatImage.data(), flatImage.data(), filteredImage.data());
+}
 
+// Function: adaptive bilateral filter (see ADAPTIVE_MODE); returns the share of the pixels
+// the bilateral filter ran on (texturedShare: the share of the tiles kept bit-identical to it)
+double adaptiveBilateralFilter(const std::vector<unsigned char>& flatImage,
+                               std::vector<unsigned char>& filteredImage,
+                               int filterSize,
+                               double sigmaI,
+                               double sigmaS,
+                               double& texturedShare) {
+    BilateralFilterPlan plan = createBilateralFilterPlan(filterSize, sigmaI, sigmaS);
+    AdaptiveDenoisePlan adaptivePlan = createAdaptiveDenoisePlan(WIDTH, HEIGHT, ADAPTIVE_TILE_SIZE,
+                                                                 ADAPTIVE_THRESHOLD, ADAPTIVE_SMOOTH_RADIUS);
+    executeAdaptiveDenoisePlan(adaptivePlan, flatImage, filteredImage,
+        [&](int rowBegin, int rowEnd, int colBegin, int colEnd, std::vector<unsigned char>& detail) {
+            executeBilateralFilterRegion(plan, flatImage, detail, rowBegin, rowEnd, colBegin, colEnd);
+        });
+    texturedShare = static_cast<double>(adaptivePlan.texturedTiles) / (adaptivePlan.tilesX * adaptivePlan.tilesY);
+    return static_cast<double>(adaptivePlan.filteredPixels) / (static_cast<double>(WIDTH) * HEIGHT);
+}
 
 int main() {
     std::string inputFilename = "./images/Flower_gray_noisy.raw";
@@ -95,8 +187,17 @@ int main() {
     double sigmaI = 12.0; // Intensity sigma
     double sigmaS = 16.0; // Spatial sigma
 
-    // Apply bilateral filter 
-    bilateralFilter(image_data, bilateral_filtered_image, filterSize, sigmaI, sigmaS);
+    // Apply bilateral filter (or its guided filter replacement)
+    if (GUIDED_FILTER_MODE) {
+        guidedFilter(image_data, bilateral_filtered_image, filterSize / 2, sigmaI * sigmaI);
+    } else if (ADAPTIVE_MODE) {
+        double texturedShare = 0.0;
+        double share = adaptiveBilateralFilter(image_data, bilateral_filtered_image, filterSize, sigmaI, sigmaS, texturedShare);
+        std::cout << "Adaptive mode: bilateral filter on " << static_cast<int>(share * 100 + 0.5) << "% of the pixels ("
+                  << static_cast<int>(texturedShare * 100 + 0.5) << "% of the tiles textured)." << std::endl;
+    } else {
+        bilateralFilter(image_data, bilateral_filtered_image, filterSize, sigmaI, sigmaS);
+    }
 
     // save the filtered images
     writeRawImage(bilateralOutputFilename, bilateral_filtered_image);
@@ -1,13 +1,43 @@
 #include <vector>
+#include <array>
 #include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <thread>
+
+#include "channelLayout.h"
+#include "gaussianFilter.h"
+#include "cpuDispatch.h"
+#if defined(MEMORY_PROFILE_BUILD)
+#define MEMORY_PROFILER_IMPLEMENTATION   // heap hooks for MEMORY_PROFILE (memoryProfiler.h)
+#endif
+#include "memoryProfiler.h"
 
 const int WIDTH = 768; // To be adjusted according to your image's width
 const int HEIGHT = 512; // To be adjusted according to your image's height
 
+// planar execution mode: split B/G/R once at load, filter each plane on its own thread,
+// and reinterleave only at write time
+const bool PLANAR_MODE = true;
+
+// sigma at or above which applyGaussianFilter switches to the recursive (IIR) Gaussian
+const double RECURSIVE_GAUSSIAN_SIGMA = 4.0;
+
+// fixed-point mode: small kernels run with integer weights and SIMD integer accumulators
+// (within one gray level of the double loops)
+const bool FIXED_POINT_MODE = false;
+
+// auto-tuning: time the Gaussian variants and FFT tile sizes once per host and shape, and
+// reuse the winners from AUTO_TUNE_FILE on later runs (otherwise the measured crossovers)
+const bool AUTO_TUNE = true;
+
+// memory profile: count allocations per stage (memoryProfiler.h) and print bytes allocated,
+// net and peak heap per stage and the peak RSS to std::cerr at the end (the heap columns
+// need a -DMEMORY_PROFILE_BUILD build, which hooks operator new / delete)
+const bool MEMORY_PROFILE = false;
+
 // Helper function: read RAW image data
 std::vector<unsigned char> readRawImage(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary);
@@ -31,115 +61,156 @@ void writeRawImage(const std::string& filename,
     file.write(reinterpret_cast<const char*>(&image_data[0]), image_data.size() * sizeof(unsigned char));
 }
 
-// Helper function to clamp pixel values
-inline unsigned char clamp(int value, int low, int high) {
-    return static_cast<unsigned char>(std::max(low, std::min(value, high)));
-}
-
-// Helper function to calculate the median of a small array
-template <size_t size>
-unsigned char median(std::array<unsigned char, size> &values) {
-    std::nth_element(values.begin(), values.begin() + size / 2, values.end());
-    return values[size / 2];
+// Helper function: pick the dispatched sorting-network median for a kernel size (3 x 3 and
+// 5 x 5; nullptr otherwise)
+decltype(CpuKernels::median3x3Row) medianNetwork(int kernelSize) {
+    if (kernelSize == 3) {
+        return cpuKernels().median3x3Row;
+    }
+    if (kernelSize == 5) {
+        return cpuKernels().median5x5Row;
+    }
+    return nullptr;
 }
 
-// Function: median filter for RGB image
-std::vector<unsigned char> applyMedianFilter(const std::vector<unsigned char>& image, int kernelSize) {
-    std::vector<unsigned char> output(image.size());
-    int edge = kernelSize / 2;
-
-    for (int y = 0; y < HEIGHT; ++y) {
+// Function: median filter for rows [rowBegin, rowEnd) of an image with 1 (plane) or 3
+// (interleaved) channels; output already sized. Windows inside the image run through the
+// sorting networks of medianNetwork, all channels of a row in one call; the clamped border
+// (and other kernel sizes) use nth_element
+void medianFilterRows(const std::vector<unsigned char>& image,
+                      std::vector<unsigned char>& output,
+                      int channels,
+                      int kernelSize,
+                      int rowBegin,
+                      int rowEnd) {
+    std::vector<unsigned char> neighbors(kernelSize * kernelSize);
+    const int edge = kernelSize / 2;
+    const int rowBytes = WIDTH * channels;
+    const auto network = medianNetwork(kernelSize);
+    const int interiorEnd = std::max(edge, WIDTH - edge);
+
+    for (int y = rowBegin; y < rowEnd; ++y) {
+        const bool interiorRow = (network != nullptr && y >= edge && y < HEIGHT - edge);
+        if (interiorRow && interiorEnd > edge) {
+            network(&image[(y - edge) * rowBytes], rowBytes, channels, (interiorEnd - edge) * channels,
+                    &output[y * rowBytes + edge * channels]);
+        }
         for (int x = 0; x < WIDTH; ++x) {
-            std::array<std::array<unsigned char, 9>, 3> neighbors; // For each color channel
-
-            // collect neighbors for R, G, B channels
-            for (int dy = -edge; dy <= edge; ++dy) {
-                for (int dx = -edge; dx <= edge; ++dx) {
-                    int nx = std::min(std::max(x + dx, 0), WIDTH - 1);
-                    int ny = std::min(std::max(y + dy, 0), HEIGHT - 1);
-                    for (int channel = 0; channel < 3; ++channel) {
-                        neighbors[channel][3 * (dy + edge) + (dx + edge)] = image[3 * (ny * WIDTH + nx) + channel];
+            if (interiorRow && x >= edge && x < interiorEnd) {
+                x = interiorEnd - 1;
+                continue;
+            }
+            for (int channel = 0; channel < channels; ++channel) {
+                // collect the window, row by row
+                int count = 0;
+                for (int dy = -edge; dy <= edge; ++dy) {
+                    const unsigned char* row = &image[std::min(std::max(y + dy, 0), HEIGHT - 1) * rowBytes];
+                    for (int dx = -edge; dx <= edge; ++dx) {
+                        neighbors[count++] = row[std::min(std::max(x + dx, 0), WIDTH - 1) * channels + channel];
                     }
                 }
-            }
 
-            // compute median for each channel
-            for (int channel = 0; channel < 3; ++channel) {
-                output[3 * (y * WIDTH + x) + channel] = median(neighbors[channel]);
+                std::nth_element(neighbors.begin(), neighbors.begin() + count / 2, neighbors.end());
+                output[y * rowBytes + x * channels + channel] = neighbors[count / 2];
             }
         }
     }
+}
 
+// Function: median filter for RGB image
+std::vector<unsigned char> applyMedianFilter(const std::vector<unsigned char>& image, int kernelSize) {
+    std::vector<unsigned char> output(image.size());
+    medianFilterRows(image, output, 3, kernelSize, 0, HEIGHT);
     return output;
 }
 
-// Helper Function: Gaussian function
-double gaussian(double x, double sigma) {
-    return std::exp(-(x * x) / (2 * sigma * sigma)) / (std::sqrt(2 * M_PI) * sigma);
+// Function: median filter for a single channel plane
+std::vector<unsigned char> applyMedianFilterPlane(const std::vector<unsigned char>& plane,
+                                                  int kernelSize) {
+    std::vector<unsigned char> output(plane.size());
+    medianFilterRows(plane, output, 1, kernelSize, 0, HEIGHT);
+    return output;
 }
 
-// Function: apply Gaussian filter for RGB image
+// Gaussian filter choices for GAUSSIAN_AUTO plans (gaussianFilter.h)
+const GaussianFilterSettings GAUSSIAN_SETTINGS = {RECURSIVE_GAUSSIAN_SIGMA, FIXED_POINT_MODE, AUTO_TUNE};
+
+// Function: apply Gaussian filter for RGB image (a one-off plan; reuse a plan for batches)
 std::vector<unsigned char> applyGaussianFilter(const std::vector<unsigned char>& image, int kernelSize, double sigma) {
+    GaussianFilterPlan plan = createGaussianFilterPlan(WIDTH, HEIGHT, 3, kernelSize, sigma, GAUSSIAN_SETTINGS);
     std::vector<unsigned char> output(image.size());
-    int edge = kernelSize / 2;
-    std::vector<double> kernel(kernelSize * kernelSize);
-    double sum = 0.0;
-    double twoSigmaSquare = 2.0 * sigma * sigma;
-
-    // generate Gaussian kernel
-    for (int i = -edge; i <= edge; ++i) {
-        for (int j = -edge; j <= edge; ++j) {
-            int index = (i + edge) * kernelSize + (j + edge);
-            kernel[index] = gaussian(std::sqrt(i * i + j * j), sigma);
-            sum += kernel[index];
-        }
-    }
-
-    // normalize the kernel
-    for (double &value : kernel) {
-        value /= sum;
-    }
-
-    // apply Gaussian filter
-    for (int y = 0; y < HEIGHT; ++y) {
-        for (int x = 0; x < WIDTH; ++x) {
-            for (int channel = 0; channel < 3; ++channel) {
-                double weightedSum = 0.0;
-
-                for (int dy = -edge; dy <= edge; ++dy) {
-                    for (int dx = -edge; dx <= edge; ++dx) {
-                        int nx = std::min(std::max(x + dx, 0), WIDTH - 1);
-                        int ny = std::min(std::max(y + dy, 0), HEIGHT - 1);
-                        int index = (dy + edge) * kernelSize + (dx + edge);
-                        weightedSum += image[3 * (ny * WIDTH + nx) + channel] * kernel[index];
-                    }
-                }
-
-                output[3 * (y * WIDTH + x) + channel] = clamp(static_cast<int>(weightedSum), 0, 255);
-            }
-        }
-    }
+    executeGaussianFilterPlan(plan, image, output);
+    return output;
+}
 
+// Function: apply Gaussian filter for a single channel plane
+std::vector<unsigned char> applyGaussianFilterPlane(const std::vector<unsigned char>& plane, int kernelSize, double sigma) {
+    GaussianFilterPlan plan = createGaussianFilterPlan(WIDTH, HEIGHT, 1, kernelSize, sigma, GAUSSIAN_SETTINGS);
+    std::vector<unsigned char> output(plane.size());
+    executeGaussianFilterPlan(plan, plane, output);
     return output;
 }
 
 int main() {
+    if (MEMORY_PROFILE) {
+        enableMemoryProfiler();
+    }
     std::string inputFilename = "./images/Flower_noisy.raw";
     std::string outputFilename = "./outputs/Flower_color_filterd.raw";
 
-    std::vector<unsigned char> inputImage = readRawImage(inputFilename);
+    std::vector<unsigned char> inputImage;
+    {
+        MemoryStage stage("read");
+        inputImage = readRawImage(inputFilename);
+    }
 
-    // Apply median filter
     int medianKernelSize = 5; 
-    std::vector<unsigned char> medianFiltered = applyMedianFilter(inputImage, medianKernelSize);
-
-    // Apply Gaussian filter
     int gaussianKernelSize = 5; 
     double gaussianSigma = 3; 
-    std::vector<unsigned char> gaussianFiltered = applyGaussianFilter(medianFiltered, gaussianKernelSize, gaussianSigma);
 
-    // save the filtered images
-    writeRawImage(outputFilename, gaussianFiltered);
+    if (PLANAR_MODE) {
+        // split once, run median -> Gaussian per plane in parallel, merge once
+        std::array<std::vector<unsigned char>, 3> planes;
+        {
+            MemoryStage stage("deinterleave");
+            deinterleaveChannels(inputImage, planes);
+        }
+
+        runPerChannel(planes, [&](std::vector<unsigned char>& plane, int /* channel */) {
+            {
+                MemoryStage stage("median");
+                plane = applyMedianFilterPlane(plane, medianKernelSize);
+            }
+            MemoryStage stage("gaussian");
+            plane = applyGaussianFilterPlane(plane, gaussianKernelSize, gaussianSigma);
+        });
+
+        {
+            MemoryStage stage("write");
+            writeRawImage(outputFilename, interleaveChannels(planes));
+        }
+    } else {
+        // Apply median filter
+        std::vector<unsigned char> medianFiltered;
+        {
+            MemoryStage stage("median");
+            medianFiltered = applyMedianFilter(inputImage, medianKernelSize);
+        }
+
+        // Apply Gaussian filter
+        std::vector<unsigned char> gaussianFiltered;
+        {
+            MemoryStage stage("gaussian");
+            gaussianFiltered = applyGaussianFilter(medianFiltered, gaussianKernelSize, gaussianSigma);
+        }
 
+        // save the filtered images
+        MemoryStage stage("write");
+        writeRawImage(outputFilename, gaussianFiltered);
+    }
+
+    if (MEMORY_PROFILE) {
+        printMemoryProfile(std::cerr);
+    }
     return 0;
 }
\ No newline at end of file
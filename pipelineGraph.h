@@ -0,0 +1,377 @@
+// Lazy dataflow graph for image pipelines
+//
+// Adding nodes only describes the pipeline; runPipeline executes the nodes the outputs
+// depend on:
+//   - independent branches run concurrently on a small thread pool
+//   - a pointwise node (clamp, linear combine, LUT, ...) whose primary input is a stencil
+//     (or an already fused pointwise node) with no other consumer is fused into it: it is
+//     applied in place to each band of rows right after the stencil writes that band, so it
+//     never materializes an image of its own. Its other inputs become dependencies of the
+//     stencil.
+//   - an intermediate image goes back to the buffer pool as soon as its last consumer has
+//     finished; only the outputs are kept
+//   - each task runs as a memory-profiler stage named after its head node (memoryProfiler.h;
+//     counted only once enableMemoryProfiler() has been called)
+//
+// e.g.  source -> median -> bilateral x K -> combine (fused into the last bilateral pass)
+//           \---> gaussian --------------------/
+
+#ifndef PIPELINE_GRAPH_H
+#define PIPELINE_GRAPH_H
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "memoryProfiler.h"
+
+typedef std::vector<unsigned char> PipelineImage;
+typedef int PipelineNode;
+
+// stencil: write rows [rowBegin, rowEnd) of output (already sized) from the whole input images
+typedef std::function<void(const std::vector<const PipelineImage*>& inputs, PipelineImage& output,
+                           int rowBegin, int rowEnd)> StencilFunction;
+
+// pointwise: update count values in place; extras[k] points at the same positions of extra input k
+typedef std::function<void(unsigned char* values, const std::vector<const unsigned char*>& extras,
+                           size_t count)> PointwiseFunction;
+
+// rows per band: fused pointwise operators run while the band is still in cache
+const int PIPELINE_BAND_ROWS = 16;
+
+enum PipelineNodeKind {
+    NODE_SOURCE,
+    NODE_STENCIL,
+    NODE_POINTWISE
+};
+
+struct PipelineNodeInfo {
+    PipelineNodeKind kind;
+    std::string name;
+    std::vector<PipelineNode> inputs;       // pointwise: the primary input first, then the extras
+    int channels = 1;
+    bool banded = true;                     // stencil can produce any band of rows on its own
+    bool isOutput = false;
+    StencilFunction stencil;
+    PointwiseFunction pointwise;
+    const PipelineImage* external = nullptr; // source image (not owned)
+    int task = -1;                          // runPipeline: the task producing this node's values
+};
+
+// one unit of scheduling: a stencil (or unfused pointwise node) plus the pointwise nodes fused into it
+struct PipelineTask {
+    PipelineNode head;
+    std::vector<PipelineNode> fused;
+    std::vector<int> dependencies;          // tasks whose images this task reads
+    std::vector<int> dependents;
+    int pendingDependencies = 0;
+    int remainingConsumers = 0;
+    bool keep = false;                      // holds an output
+    PipelineImage buffer;
+};
+
+struct PipelineGraph {
+    int width = 0;
+    int height = 0;
+    std::vector<PipelineNodeInfo> nodes;
+    std::vector<PipelineTask> tasks;
+    std::vector<PipelineImage> pool;        // released intermediates, reused by later tasks
+};
+
+// Function: an empty graph for width x height images
+inline PipelineGraph createPipelineGraph(int width, int height) {
+    PipelineGraph graph;
+    graph.width = width;
+    graph.height = height;
+    return graph;
+}
+
+// Function: an external input image (must outlive runPipeline)
+inline PipelineNode addSourceNode(PipelineGraph& graph, const PipelineImage& image, int channels) {
+    PipelineNodeInfo node;
+    node.kind = NODE_SOURCE;
+    node.name = "source";
+    node.channels = channels;
+    node.external = &image;
+    graph.nodes.push_back(node);
+    return static_cast<PipelineNode>(graph.nodes.size() - 1);
+}
+
+// Function: a neighbourhood operator; banded = false for operators that need to produce the
+// whole image in one call (e.g. the FFT or recursive Gaussian)
+inline PipelineNode addStencilNode(PipelineGraph& graph,
+                                   const std::string& name,
+                                   const std::vector<PipelineNode>& inputs,
+                                   int channels,
+                                   StencilFunction function,
+                                   bool banded = true) {
+    PipelineNodeInfo node;
+    node.kind = NODE_STENCIL;
+    node.name = name;
+    node.inputs = inputs;
+    node.channels = channels;
+    node.banded = banded;
+    node.stencil = function;
+    graph.nodes.push_back(node);
+    return static_cast<PipelineNode>(graph.nodes.size() - 1);
+}
+
+// Function: a pointwise operator on primary (same shape), reading extras at the same positions
+inline PipelineNode addPointwiseNode(PipelineGraph& graph,
+                                     const std::string& name,
+                                     PipelineNode primary,
+                                     const std::vector<PipelineNode>& extras,
+                                     PointwiseFunction function) {
+    PipelineNodeInfo node;
+    node.kind = NODE_POINTWISE;
+    node.name = name;
+    node.inputs.push_back(primary);
+    node.inputs.insert(node.inputs.end(), extras.begin(), extras.end());
+    node.channels = graph.nodes[primary].channels;
+    node.pointwise = function;
+    graph.nodes.push_back(node);
+    return static_cast<PipelineNode>(graph.nodes.size() - 1);
+}
+
+// Function: keep this node's image after runPipeline (see pipelineResult)
+inline void markOutput(PipelineGraph& graph, PipelineNode node) {
+    graph.nodes[node].isOutput = true;
+}
+
+// Helper function: the image holding a node's values
+inline const PipelineImage* pipelineImage(const PipelineGraph& graph, PipelineNode node) {
+    const PipelineNodeInfo& info = graph.nodes[node];
+    return (info.kind == NODE_SOURCE) ? info.external : &graph.tasks[info.task].buffer;
+}
+
+// Function: an output image, valid after runPipeline
+inline const PipelineImage& pipelineResult(const PipelineGraph& graph, PipelineNode node) {
+    return *pipelineImage(graph, node);
+}
+
+// Helper function: run one task (stencil in bands, each band followed by its fused operators)
+inline void executePipelineTask(PipelineGraph& graph, PipelineTask& task) {
+    const PipelineNodeInfo& head = graph.nodes[task.head];
+    MemoryStage stage(head.name.c_str());
+    const size_t rowBytes = static_cast<size_t>(graph.width) * head.channels;
+    task.buffer.resize(rowBytes * graph.height);
+
+    std::vector<const PipelineImage*> inputs;
+    for (PipelineNode input : head.inputs) {
+        inputs.push_back(pipelineImage(graph, input));
+    }
+    std::vector<std::vector<const unsigned char*> > extras(task.fused.size());
+
+    auto applyFused = [&](int rowBegin, int rowEnd) {
+        size_t offset = rowBytes * rowBegin;
+        size_t count = rowBytes * (rowEnd - rowBegin);
+        for (size_t f = 0; f < task.fused.size(); ++f) {
+            const PipelineNodeInfo& op = graph.nodes[task.fused[f]];
+            extras[f].clear();
+            for (size_t k = 1; k < op.inputs.size(); ++k) {
+                extras[f].push_back(pipelineImage(graph, op.inputs[k])->data() + offset);
+            }
+            op.pointwise(task.buffer.data() + offset, extras[f], count);
+        }
+    };
+
+    if (head.kind == NODE_STENCIL && !head.banded) {
+        head.stencil(inputs, task.buffer, 0, graph.height);
+        for (int row = 0; row < graph.height; row += PIPELINE_BAND_ROWS) {
+            applyFused(row, std::min(row + PIPELINE_BAND_ROWS, graph.height));
+        }
+        return;
+    }
+
+    std::vector<const unsigned char*> headExtras;
+    for (int row = 0; row < graph.height; row += PIPELINE_BAND_ROWS) {
+        int rowEnd = std::min(row + PIPELINE_BAND_ROWS, graph.height);
+        if (head.kind == NODE_STENCIL) {
+            head.stencil(inputs, task.buffer, row, rowEnd);
+        } else {
+            // unfused pointwise node: copy the primary band, then update it in place
+            size_t offset = rowBytes * row;
+            size_t count = rowBytes * (rowEnd - row);
+            std::copy(inputs[0]->begin() + offset, inputs[0]->begin() + offset + count, task.buffer.begin() + offset);
+            headExtras.clear();
+            for (size_t k = 1; k < inputs.size(); ++k) {
+                headExtras.push_back(inputs[k]->data() + offset);
+            }
+            head.pointwise(task.buffer.data() + offset, headExtras, count);
+        }
+        applyFused(row, rowEnd);
+    }
+}
+
+// Function: execute everything the outputs depend on with numThreads workers (0: one per
+// hardware thread)
+inline void runPipeline(PipelineGraph& graph, int numThreads = 0) {
+    const int numNodes = static_cast<int>(graph.nodes.size());
+
+    // lazy: only the nodes the outputs depend on are live
+    std::vector<bool> live(numNodes, false);
+    for (int n = numNodes - 1; n >= 0; --n) {
+        if (graph.nodes[n].isOutput) {
+            live[n] = true;
+        }
+        if (live[n]) {
+            for (PipelineNode input : graph.nodes[n].inputs) {
+                live[input] = true;
+            }
+        }
+    }
+    std::vector<int> consumers(numNodes, 0);
+    for (int n = 0; n < numNodes; ++n) {
+        if (live[n]) {
+            for (PipelineNode input : graph.nodes[n].inputs) {
+                consumers[input]++;
+            }
+        }
+    }
+
+    // tasks and fusion (nodes are in topological order: inputs always exist before a node)
+    graph.tasks.clear();
+    for (int n = 0; n < numNodes; ++n) {
+        PipelineNodeInfo& node = graph.nodes[n];
+        node.task = -1;
+        if (!live[n] || node.kind == NODE_SOURCE) {
+            continue;
+        }
+        if (node.kind == NODE_POINTWISE) {
+            const PipelineNodeInfo& primary = graph.nodes[node.inputs[0]];
+            if (primary.kind != NODE_SOURCE && consumers[node.inputs[0]] == 1 && !primary.isOutput) {
+                node.task = primary.task;
+                graph.tasks[node.task].fused.push_back(n);
+                graph.tasks[node.task].keep = graph.tasks[node.task].keep || node.isOutput;
+                continue;
+            }
+        }
+        PipelineTask task;
+        task.head = n;
+        task.keep = node.isOutput;
+        graph.tasks.push_back(task);
+        node.task = static_cast<int>(graph.tasks.size() - 1);
+    }
+
+    // dependencies between tasks (each input task once)
+    const int numTasks = static_cast<int>(graph.tasks.size());
+    for (int t = 0; t < numTasks; ++t) {
+        PipelineTask& task = graph.tasks[t];
+        std::vector<PipelineNode> reads = graph.nodes[task.head].inputs;
+        for (PipelineNode fused : task.fused) {
+            reads.insert(reads.end(), graph.nodes[fused].inputs.begin() + 1, graph.nodes[fused].inputs.end());
+        }
+        for (PipelineNode input : reads) {
+            int producer = graph.nodes[input].task;
+            if (producer < 0 || producer == t ||
+                std::find(task.dependencies.begin(), task.dependencies.end(), producer) != task.dependencies.end()) {
+                continue;
+            }
+            task.dependencies.push_back(producer);
+            graph.tasks[producer].dependents.push_back(t);
+            graph.tasks[producer].remainingConsumers++;
+        }
+        task.pendingDependencies = static_cast<int>(task.dependencies.size());
+    }
+
+    // thread pool over the ready tasks
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<int> ready;
+    for (int t = 0; t < numTasks; ++t) {
+        if (graph.tasks[t].pendingDependencies == 0) {
+            ready.push_back(t);
+        }
+    }
+    int finished = 0;
+    if (numThreads <= 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    numThreads = std::max(1, std::min(numThreads, numTasks));
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&]() { return !ready.empty() || finished == numTasks; });
+            if (ready.empty()) {
+                return;
+            }
+            int t = ready.back();
+            ready.pop_back();
+            PipelineTask& task = graph.tasks[t];
+            if (!graph.pool.empty()) {
+                task.buffer.swap(graph.pool.back());
+                graph.pool.pop_back();
+            }
+            lock.unlock();
+
+            executePipelineTask(graph, task);
+
+            lock.lock();
+            // release inputs whose last consumer this was, then wake the tasks it unblocks
+            for (int producer : task.dependencies) {
+                PipelineTask& input = graph.tasks[producer];
+                if (--input.remainingConsumers == 0 && !input.keep) {
+                    graph.pool.push_back(PipelineImage());
+                    graph.pool.back().swap(input.buffer);
+                }
+            }
+            for (int dependent : task.dependents) {
+                if (--graph.tasks[dependent].pendingDependencies == 0) {
+                    ready.push_back(dependent);
+                }
+            }
+            finished++;
+            wake.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < numThreads; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    graph.pool.clear();
+}
+
+// Helper functions: common pointwise operators
+
+// values = min(max(values, low), high)
+inline PointwiseFunction clampOp(unsigned char low, unsigned char high) {
+    return [low, high](unsigned char* values, const std::vector<const unsigned char*>&, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = std::min(std::max(values[i], low), high);
+        }
+    };
+}
+
+// values = lut[values]
+inline PointwiseFunction lutOp(const std::array<unsigned char, 256>& lut) {
+    return [lut](unsigned char* values, const std::vector<const unsigned char*>&, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = lut[values[i]];
+        }
+    };
+}
+
+// values = clamp(int(a * values + b * extra), 0, 255), truncated like the double loops
+inline PointwiseFunction linearCombineOp(double a, double b) {
+    return [a, b](unsigned char* values, const std::vector<const unsigned char*>& extras, size_t count) {
+        const unsigned char* other = extras[0];
+        for (size_t i = 0; i < count; ++i) {
+            int combined = static_cast<int>(a * values[i] + b * other[i]);
+            values[i] = static_cast<unsigned char>(std::min(std::max(combined, 0), 255));
+        }
+    };
+}
+
+#endif // PIPELINE_GRAPH_H
@@ -0,0 +1,551 @@
+// Self-describing chunked image container (.craw)
+//
+// Layout (all integers little-endian):
+//   header  32 bytes  magic "CRAW", version, header size, width, height, channels,
+//                     bit depth, layout (interleaved / planar), main codec, band height,
+//                     number of bands
+//   index   24 bytes per band: file offset (u64), compressed size (u32), codec (u32),
+//                              Adler-32 of the decoded chunk (u32), reserved (u32)
+//   chunks  one independently compressed chunk per band of rows
+//
+// A band of an interleaved image is bandHeight full rows. A band of a planar image is
+// the same rows of plane 0, then plane 1, and so on, so decoding a band never needs
+// another chunk. Chunks are compressed with horizontal delta + byte RLE, or stored as-is
+// when that would not make them smaller.
+
+#ifndef RAW_CONTAINER_H
+#define RAW_CONTAINER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum ContainerLayout {
+    LAYOUT_INTERLEAVED = 0,
+    LAYOUT_PLANAR = 1
+};
+
+enum ContainerCodec {
+    CODEC_STORED = 0,
+    CODEC_DELTA_RLE = 1
+};
+
+struct ContainerInfo {
+    int width = 0;
+    int height = 0;
+    int channels = 1;
+    int bitDepth = 8;
+    ContainerLayout layout = LAYOUT_INTERLEAVED;
+    int bandHeight = 32;
+    int numBands = 0;
+};
+
+struct ContainerIndexEntry {
+    uint64_t offset;
+    uint32_t compressedSize;
+    uint32_t codec;
+    uint32_t checksum;
+};
+
+const char CONTAINER_MAGIC[4] = {'C', 'R', 'A', 'W'};
+const uint16_t CONTAINER_VERSION = 1;
+const size_t CONTAINER_HEADER_SIZE = 32;
+const size_t CONTAINER_INDEX_ENTRY_SIZE = 24;
+
+// Helper function: little-endian field access
+inline void putLE(unsigned char* dst, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        dst[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+inline uint64_t getLE(const unsigned char* src, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(src[i]) << (8 * i);
+    }
+    return value;
+}
+
+// Helper function: Adler-32 checksum, used to detect corrupt chunks
+inline uint32_t adler32(const unsigned char* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t block = std::min(size, static_cast<size_t>(5552));
+        for (size_t i = 0; i < block; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += block;
+        size -= block;
+    }
+    return (b << 16) | a;
+}
+
+// Helper function: bytes of one full row of one plane (planar) or of all channels (interleaved)
+inline size_t containerRowBytes(const ContainerInfo& info) {
+    size_t sampleBytes = info.bitDepth / 8;
+    size_t samplesPerRow = (info.layout == LAYOUT_PLANAR) ? info.width : static_cast<size_t>(info.width) * info.channels;
+    return samplesPerRow * sampleBytes;
+}
+
+// Helper function: distance in bytes between a byte and the same byte of the previous pixel
+inline size_t containerDeltaStride(const ContainerInfo& info) {
+    size_t sampleBytes = info.bitDepth / 8;
+    return (info.layout == LAYOUT_PLANAR) ? sampleBytes : sampleBytes * info.channels;
+}
+
+inline size_t containerImageBytes(const ContainerInfo& info) {
+    return static_cast<size_t>(info.width) * info.height * info.channels * (info.bitDepth / 8);
+}
+
+// Helper function: rows in a given band (the last one may be short)
+inline int containerBandRows(const ContainerInfo& info, int band) {
+    return std::min(info.bandHeight, info.height - band * info.bandHeight);
+}
+
+// Helper function: gather band rows into one contiguous chunk (planes one after another)
+inline void gatherBand(const std::vector<unsigned char>& image, const ContainerInfo& info, int band,
+                       std::vector<unsigned char>& chunk) {
+    size_t rowBytes = containerRowBytes(info);
+    int rows = containerBandRows(info, band);
+    int planes = (info.layout == LAYOUT_PLANAR) ? info.channels : 1;
+    size_t planeBytes = rowBytes * info.height;
+    chunk.resize(rowBytes * rows * planes);
+    for (int p = 0; p < planes; ++p) {
+        const unsigned char* src = image.data() + p * planeBytes + static_cast<size_t>(band) * info.bandHeight * rowBytes;
+        std::memcpy(chunk.data() + p * rowBytes * rows, src, rowBytes * rows);
+    }
+}
+
+// Helper function: inverse of gatherBand
+inline void scatterBand(const std::vector<unsigned char>& chunk, const ContainerInfo& info, int band,
+                        unsigned char* image) {
+    size_t rowBytes = containerRowBytes(info);
+    int rows = containerBandRows(info, band);
+    int planes = (info.layout == LAYOUT_PLANAR) ? info.channels : 1;
+    size_t planeBytes = rowBytes * info.height;
+    for (int p = 0; p < planes; ++p) {
+        unsigned char* dst = image + p * planeBytes + static_cast<size_t>(band) * info.bandHeight * rowBytes;
+        std::memcpy(dst, chunk.data() + p * rowBytes * rows, rowBytes * rows);
+    }
+}
+
+// Function: reorder an interleaved image into planes (plane 0, then plane 1, ...)
+inline std::vector<unsigned char> interleavedToPlanar(const std::vector<unsigned char>& image, const ContainerInfo& info) {
+    size_t sampleBytes = info.bitDepth / 8;
+    size_t numPixels = static_cast<size_t>(info.width) * info.height;
+    std::vector<unsigned char> planar(image.size());
+    for (size_t i = 0; i < numPixels; ++i) {
+        for (int c = 0; c < info.channels; ++c) {
+            std::memcpy(&planar[(c * numPixels + i) * sampleBytes], &image[(i * info.channels + c) * sampleBytes], sampleBytes);
+        }
+    }
+    return planar;
+}
+
+// Function: inverse of interleavedToPlanar
+inline std::vector<unsigned char> planarToInterleaved(const std::vector<unsigned char>& planar, const ContainerInfo& info) {
+    size_t sampleBytes = info.bitDepth / 8;
+    size_t numPixels = static_cast<size_t>(info.width) * info.height;
+    std::vector<unsigned char> image(planar.size());
+    for (size_t i = 0; i < numPixels; ++i) {
+        for (int c = 0; c < info.channels; ++c) {
+            std::memcpy(&image[(i * info.channels + c) * sampleBytes], &planar[(c * numPixels + i) * sampleBytes], sampleBytes);
+        }
+    }
+    return image;
+}
+
+// Function: delta + RLE encode a chunk made of whole rows
+// control byte c < 128: c + 1 literal bytes follow; c >= 128: the next byte repeats c - 125 times
+inline std::vector<unsigned char> encodeDeltaRLE(const std::vector<unsigned char>& chunk, size_t rowBytes, size_t stride) {
+    // horizontal delta within each row, modulo 256
+    std::vector<unsigned char> delta(chunk.size());
+    for (size_t rowStart = 0; rowStart < chunk.size(); rowStart += rowBytes) {
+        const unsigned char* row = chunk.data() + rowStart;
+        unsigned char* out = delta.data() + rowStart;
+        for (size_t i = 0; i < std::min(stride, rowBytes); ++i) {
+            out[i] = row[i];
+        }
+        for (size_t i = stride; i < rowBytes; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - row[i - stride]);
+        }
+    }
+
+    std::vector<unsigned char> encoded;
+    encoded.reserve(delta.size() / 2);
+    size_t i = 0;
+    while (i < delta.size()) {
+        // measure the run starting here
+        size_t run = 1;
+        while (i + run < delta.size() && run < 130 && delta[i + run] == delta[i]) {
+            run++;
+        }
+        if (run >= 3) {
+            encoded.push_back(static_cast<unsigned char>(run + 125));
+            encoded.push_back(delta[i]);
+            i += run;
+            continue;
+        }
+
+        // literal stretch up to the next run of 3 or 128 bytes
+        size_t start = i;
+        while (i < delta.size() && i - start < 128) {
+            if (i + 2 < delta.size() && delta[i] == delta[i + 1] && delta[i] == delta[i + 2]) {
+                break;
+            }
+            i++;
+        }
+        encoded.push_back(static_cast<unsigned char>(i - start - 1));
+        encoded.insert(encoded.end(), delta.begin() + start, delta.begin() + i);
+    }
+
+    return encoded;
+}
+
+// Function: inverse of encodeDeltaRLE; returns false on corrupt input
+inline bool decodeDeltaRLE(const unsigned char* encoded, size_t encodedSize,
+                           std::vector<unsigned char>& chunk, size_t rowBytes, size_t stride) {
+    size_t out = 0;
+    size_t i = 0;
+    while (i < encodedSize) {
+        unsigned char control = encoded[i++];
+        if (control < 128) {
+            size_t count = control + 1;
+            if (i + count > encodedSize || out + count > chunk.size()) {
+                return false;
+            }
+            std::memcpy(chunk.data() + out, encoded + i, count);
+            i += count;
+            out += count;
+        } else {
+            size_t count = control - 125;
+            if (i >= encodedSize || out + count > chunk.size()) {
+                return false;
+            }
+            std::memset(chunk.data() + out, encoded[i++], count);
+            out += count;
+        }
+    }
+    if (out != chunk.size()) {
+        return false;
+    }
+
+    // undo the horizontal delta
+    for (size_t rowStart = 0; rowStart < chunk.size(); rowStart += rowBytes) {
+        unsigned char* row = chunk.data() + rowStart;
+        for (size_t j = stride; j < rowBytes; ++j) {
+            row[j] = static_cast<unsigned char>(row[j] + row[j - stride]);
+        }
+    }
+    return true;
+}
+
+// Helper function: bytes of a decoded band (all planes, for planar files)
+inline size_t containerBandBytes(const ContainerInfo& info, int band) {
+    int planes = (info.layout == LAYOUT_PLANAR) ? info.channels : 1;
+    return containerRowBytes(info) * containerBandRows(info, band) * planes;
+}
+
+// Helper function: decode one chunk according to its index entry; `available` is the number
+// of bytes readable at data, and nothing past it is touched
+inline bool decodeChunk(const unsigned char* data, size_t available, const ContainerIndexEntry& entry,
+                        const ContainerInfo& info, int band, std::vector<unsigned char>& chunk) {
+    if (entry.compressedSize > available) {
+        return false;
+    }
+    size_t rowBytes = containerRowBytes(info);
+    chunk.resize(containerBandBytes(info, band));
+    bool decoded = false;
+    if (entry.codec == CODEC_STORED && entry.compressedSize == chunk.size()) {
+        std::memcpy(chunk.data(), data, chunk.size());
+        decoded = true;
+    } else if (entry.codec == CODEC_DELTA_RLE) {
+        decoded = decodeDeltaRLE(data, entry.compressedSize, chunk, rowBytes, containerDeltaStride(info));
+    }
+    return decoded && adler32(chunk.data(), chunk.size()) == entry.checksum;
+}
+
+// Helper function: parse and validate the header and index. Every index entry must lie
+// after the index and inside the file, with a size its codec can produce for the band
+// (stored: exactly the band; delta + RLE: smaller, and at most 65 times smaller), so the
+// readers never allocate or read more than the file holds.
+inline bool readContainerHeader(std::ifstream& file, ContainerInfo& info, std::vector<ContainerIndexEntry>& index) {
+    file.seekg(0, std::ios::end);
+    const std::streamoff fileEnd = file.tellg();
+    file.seekg(0, std::ios::beg);
+    if (fileEnd < 0) {
+        return false;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(fileEnd);
+
+    unsigned char header[CONTAINER_HEADER_SIZE];
+    if (!file.read(reinterpret_cast<char*>(header), CONTAINER_HEADER_SIZE) ||
+        std::memcmp(header, CONTAINER_MAGIC, 4) != 0) {
+        return false;
+    }
+    if (getLE(header + 4, 2) != CONTAINER_VERSION) {
+        std::cerr << "Unsupported container version: " << getLE(header + 4, 2) << std::endl;
+        return false;
+    }
+    if (getLE(header + 6, 2) != CONTAINER_HEADER_SIZE || header[20] > LAYOUT_PLANAR || header[21] > CODEC_DELTA_RLE) {
+        std::cerr << "Corrupt container header." << std::endl;
+        return false;
+    }
+
+    info.width = static_cast<int>(getLE(header + 8, 4));
+    info.height = static_cast<int>(getLE(header + 12, 4));
+    info.channels = static_cast<int>(getLE(header + 16, 2));
+    info.bitDepth = static_cast<int>(getLE(header + 18, 2));
+    info.layout = static_cast<ContainerLayout>(header[20]);
+    info.bandHeight = static_cast<int>(getLE(header + 24, 4));
+    info.numBands = static_cast<int>(getLE(header + 28, 4));
+    if (info.width <= 0 || info.height <= 0 || info.channels <= 0 || info.bandHeight <= 0 ||
+        (info.bitDepth != 8 && info.bitDepth != 16) ||
+        info.numBands != (static_cast<int64_t>(info.height) + info.bandHeight - 1) / info.bandHeight) {
+        std::cerr << "Corrupt container header." << std::endl;
+        return false;
+    }
+    // no band decodes to more than 65 times its chunk, so neither can the image (this also
+    // keeps the size arithmetic below far from overflowing)
+    if (static_cast<double>(info.width) * info.height * info.channels * (info.bitDepth / 8) > 65.0 * fileSize) {
+        std::cerr << "Container shape does not fit the file size." << std::endl;
+        return false;
+    }
+
+    const uint64_t indexEnd = CONTAINER_HEADER_SIZE + static_cast<uint64_t>(info.numBands) * CONTAINER_INDEX_ENTRY_SIZE;
+    if (indexEnd > fileSize) {
+        std::cerr << "Truncated container index." << std::endl;
+        return false;
+    }
+    std::vector<unsigned char> rawIndex(indexEnd - CONTAINER_HEADER_SIZE);
+    if (!file.read(reinterpret_cast<char*>(rawIndex.data()), rawIndex.size())) {
+        std::cerr << "Truncated container index." << std::endl;
+        return false;
+    }
+    index.resize(info.numBands);
+    for (int band = 0; band < info.numBands; ++band) {
+        const unsigned char* entry = rawIndex.data() + band * CONTAINER_INDEX_ENTRY_SIZE;
+        index[band].offset = getLE(entry, 8);
+        index[band].compressedSize = static_cast<uint32_t>(getLE(entry + 8, 4));
+        index[band].codec = static_cast<uint32_t>(getLE(entry + 12, 4));
+        index[band].checksum = static_cast<uint32_t>(getLE(entry + 16, 4));
+
+        const uint64_t bandBytes = containerBandBytes(info, band);
+        const uint64_t size = index[band].compressedSize;
+        const bool sizeFits = (index[band].codec == CODEC_STORED && size == bandBytes) ||
+                              (index[band].codec == CODEC_DELTA_RLE && size < bandBytes && size * 65 >= bandBytes);
+        if (!sizeFits || index[band].offset < indexEnd || index[band].offset > fileSize ||
+            size > fileSize - index[band].offset) {
+            std::cerr << "Corrupt container index entry for band " << band << "." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function: check whether a file starts with the container magic
+inline bool isContainerFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    char magic[4] = {0};
+    return file.read(magic, 4) && std::memcmp(magic, CONTAINER_MAGIC, 4) == 0;
+}
+
+// Function: read only the shape of a container file
+inline bool readContainerInfo(const std::string& filename, ContainerInfo& info) {
+    std::ifstream file(filename, std::ios::binary);
+    std::vector<ContainerIndexEntry> index;
+    return file && readContainerHeader(file, info, index);
+}
+
+// Function: write an image (interleaved or planar, as given by info.layout) as a container
+inline bool writeContainer(const std::string& filename,
+                           const std::vector<unsigned char>& image,
+                           ContainerInfo info) {
+    if (info.bandHeight <= 0 || image.size() != containerImageBytes(info)) {
+        std::cerr << "Image size does not match the container shape: " << filename << std::endl;
+        return false;
+    }
+    info.numBands = (info.height + info.bandHeight - 1) / info.bandHeight;
+
+    // compress every band independently, in parallel
+    std::vector<std::vector<unsigned char> > chunks(info.numBands);
+    std::vector<uint32_t> codecs(info.numBands);
+    std::vector<uint32_t> checksums(info.numBands);
+    int numThreads = std::max(1, std::min(info.numBands, static_cast<int>(std::thread::hardware_concurrency())));
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&, t]() {
+            std::vector<unsigned char> band;
+            for (int b = t; b < info.numBands; b += numThreads) {
+                gatherBand(image, info, b, band);
+                checksums[b] = adler32(band.data(), band.size());
+                chunks[b] = encodeDeltaRLE(band, containerRowBytes(info), containerDeltaStride(info));
+                codecs[b] = CODEC_DELTA_RLE;
+                if (chunks[b].size() >= band.size()) {
+                    chunks[b].swap(band);
+                    codecs[b] = CODEC_STORED;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // header
+    std::vector<unsigned char> head(CONTAINER_HEADER_SIZE + info.numBands * CONTAINER_INDEX_ENTRY_SIZE, 0);
+    std::memcpy(head.data(), CONTAINER_MAGIC, 4);
+    putLE(&head[4], CONTAINER_VERSION, 2);
+    putLE(&head[6], CONTAINER_HEADER_SIZE, 2);
+    putLE(&head[8], info.width, 4);
+    putLE(&head[12], info.height, 4);
+    putLE(&head[16], info.channels, 2);
+    putLE(&head[18], info.bitDepth, 2);
+    head[20] = static_cast<unsigned char>(info.layout);
+    head[21] = CODEC_DELTA_RLE;
+    putLE(&head[24], info.bandHeight, 4);
+    putLE(&head[28], info.numBands, 4);
+
+    // index
+    uint64_t offset = head.size();
+    for (int b = 0; b < info.numBands; ++b) {
+        unsigned char* entry = &head[CONTAINER_HEADER_SIZE + b * CONTAINER_INDEX_ENTRY_SIZE];
+        putLE(entry, offset, 8);
+        putLE(entry + 8, chunks[b].size(), 4);
+        putLE(entry + 12, codecs[b], 4);
+        putLE(entry + 16, checksums[b], 4);
+        offset += chunks[b].size();
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open the file for writing: " << filename << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(head.data()), head.size());
+    for (const auto& chunk : chunks) {
+        file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    }
+    if (!file.good()) {
+        std::cerr << "Error occurred at writing time!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Function: read and decode a whole container, chunks decoded in parallel
+// returns an empty vector on error
+inline std::vector<unsigned char> readContainer(const std::string& filename, ContainerInfo& info) {
+    std::ifstream file(filename, std::ios::binary);
+    std::vector<ContainerIndexEntry> index;
+    if (!file || !readContainerHeader(file, info, index)) {
+        std::cerr << "Cannot read the container: " << filename << std::endl;
+        return std::vector<unsigned char>();
+    }
+
+    // read the span covering every chunk in one go (the writer puts them back to back; the
+    // index has been checked against the file size, so the span is no larger than the file)
+    uint64_t start = index.front().offset;
+    uint64_t end = start;
+    for (const ContainerIndexEntry& entry : index) {
+        start = std::min(start, entry.offset);
+        end = std::max(end, entry.offset + entry.compressedSize);
+    }
+    std::vector<unsigned char> data(end - start);
+    file.seekg(start);
+    if (!file.read(reinterpret_cast<char*>(data.data()), data.size())) {
+        std::cerr << "Truncated container: " << filename << std::endl;
+        return std::vector<unsigned char>();
+    }
+
+    std::vector<unsigned char> image(containerImageBytes(info));
+    std::vector<char> ok(info.numBands, 1);
+    int numThreads = std::max(1, std::min(info.numBands, static_cast<int>(std::thread::hardware_concurrency())));
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&, t]() {
+            std::vector<unsigned char> chunk;
+            for (int b = t; b < info.numBands; b += numThreads) {
+                const uint64_t chunkStart = index[b].offset - start;
+                ok[b] = decodeChunk(data.data() + chunkStart, data.size() - chunkStart, index[b], info, b, chunk);
+                if (ok[b]) {
+                    scatterBand(chunk, info, b, image.data());
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end()) {
+        std::cerr << "Corrupt chunk in container: " << filename << std::endl;
+        return std::vector<unsigned char>();
+    }
+    return image;
+}
+
+// Function: seek to one band and decode only that chunk
+// the result holds containerBandRows(info, band) rows (of every plane, for planar files)
+inline std::vector<unsigned char> readContainerBand(const std::string& filename, int band, ContainerInfo& info) {
+    std::ifstream file(filename, std::ios::binary);
+    std::vector<ContainerIndexEntry> index;
+    if (!file || !readContainerHeader(file, info, index) || band < 0 || band >= info.numBands) {
+        std::cerr << "Cannot read band " << band << " of the container: " << filename << std::endl;
+        return std::vector<unsigned char>();
+    }
+
+    std::vector<unsigned char> data(index[band].compressedSize);
+    std::vector<unsigned char> chunk;
+    file.seekg(index[band].offset);
+    if (!file.read(reinterpret_cast<char*>(data.data()), data.size()) ||
+        !decodeChunk(data.data(), data.size(), index[band], info, band, chunk)) {
+        std::cerr << "Corrupt chunk in container: " << filename << std::endl;
+        return std::vector<unsigned char>();
+    }
+    return chunk;
+}
+
+// Function: read either a container or a headerless raw file (raw read is the fallback;
+// its shape cannot be checked)
+inline std::vector<unsigned char> readImageFile(const std::string& filename, ContainerInfo& info) {
+    if (isContainerFile(filename)) {
+        return readContainer(filename, info);
+    }
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot open the file: " << filename << std::endl;
+        return std::vector<unsigned char>();
+    }
+    return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// Function: write a container when the name ends in .craw, a headerless raw file otherwise
+inline bool writeImageFile(const std::string& filename, const std::vector<unsigned char>& image, const ContainerInfo& info) {
+    const std::string extension = ".craw";
+    if (filename.size() >= extension.size() &&
+        filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0) {
+        return writeContainer(filename, image, info);
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open the file for writing: " << filename << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(image.data()), image.size());
+    return file.good();
+}
+
+#endif // RAW_CONTAINER_H
@@ -0,0 +1,87 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "rawContainer.h"
+
+// Usage:
+//   rawConvert pack   <in.raw> <out.craw> <width> <height> <channels> [planar] [bandHeight]
+//   rawConvert unpack <in.craw> <out.raw>          (always writes interleaved raw)
+//   rawConvert info   <file.craw>
+//
+// e.g. ./rawConvert pack ./outputs/Flower_water_colored.raw ./outputs/Flower_water_colored.craw 768 512 3
+
+// Function: print the shape and per-band sizes of a container
+int printContainerInfo(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    ContainerInfo info;
+    std::vector<ContainerIndexEntry> index;
+    if (!file || !readContainerHeader(file, info, index)) {
+        std::cerr << "Not a container file: " << filename << std::endl;
+        return 1;
+    }
+
+    uint64_t compressed = 0;
+    int stored = 0;
+    for (const auto& entry : index) {
+        compressed += entry.compressedSize;
+        stored += (entry.codec == CODEC_STORED);
+    }
+
+    std::cout << filename << ": " << info.width << "x" << info.height
+              << ", " << info.channels << " channel(s), " << info.bitDepth << "-bit, "
+              << (info.layout == LAYOUT_PLANAR ? "planar" : "interleaved") << std::endl;
+    std::cout << info.numBands << " bands of " << info.bandHeight << " rows ("
+              << stored << " stored), " << compressed << " / " << containerImageBytes(info)
+              << " bytes of image data" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string mode = (argc > 1) ? argv[1] : "";
+
+    if (mode == "pack" && argc >= 7) {
+        ContainerInfo info;
+        info.width = std::atoi(argv[4]);
+        info.height = std::atoi(argv[5]);
+        info.channels = std::atoi(argv[6]);
+        info.layout = (argc > 7 && std::string(argv[7]) == "planar") ? LAYOUT_PLANAR : LAYOUT_INTERLEAVED;
+        if (argc > 8) {
+            info.bandHeight = std::atoi(argv[8]);
+        }
+
+        // raw files are interleaved; planar containers store the planes one after another
+        std::vector<unsigned char> image = readImageFile(argv[2], info);
+        if (info.layout == LAYOUT_PLANAR && image.size() == containerImageBytes(info)) {
+            image = interleavedToPlanar(image, info);
+        }
+        if (image.empty() || !writeContainer(argv[3], image, info)) {
+            return 1;
+        }
+        return printContainerInfo(argv[3]);
+    }
+
+    if (mode == "unpack" && argc == 4) {
+        ContainerInfo info;
+        std::vector<unsigned char> image = readContainer(argv[2], info);
+        if (image.empty()) {
+            return 1;
+        }
+        if (info.layout == LAYOUT_PLANAR) {
+            image = planarToInterleaved(image, info);
+        }
+        std::ofstream outFile(argv[3], std::ios::binary);
+        outFile.write(reinterpret_cast<const char*>(image.data()), image.size());
+        return outFile.good() ? 0 : 1;
+    }
+
+    if (mode == "info" && argc == 3) {
+        return printContainerInfo(argv[2]);
+    }
+
+    std::cerr << "Usage: rawConvert pack <in.raw> <out.craw> <width> <height> <channels> [planar] [bandHeight]" << std::endl;
+    std::cerr << "       rawConvert unpack <in.craw> <out.raw>" << std::endl;
+    std::cerr << "       rawConvert info <file.craw>" << std::endl;
+    return 1;
+}
@@ -0,0 +1,530 @@
+// Out-of-core tiled image storage
+//
+// A TiledImage lives in a file as square tiles (tileSize x tileSize pixels, interleaved
+// channels, edge tiles padded to full size), so any tile is one seek + one read. Only an LRU
+// cache of tiles is held in memory; dirty tiles are written back on eviction and on close.
+// A background thread prefetches tiles that a caller announces it will need (the next block
+// of a raster scan plus its halo), so the file reads overlap with the computation.
+//
+// All pixel coordinates and offsets are 64-bit: images far above the 2^31 bytes an int index
+// can address (e.g. gigapixel RGB mosaics) work as long as the cache fits in memory.
+//
+// Operators run block by block: applyTiledStencil hands each tile, with a halo of replicated
+// edges, to a neighborhood function; tiledCLAHE needs the global tile histograms, so it makes
+// one streaming pass to collect them and a second one to map the pixels.
+
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+const int TILED_IMAGE_TILE_SIZE = 256;
+const int TILED_IMAGE_CACHE_TILES = 64;
+
+struct TileCacheEntry {
+    std::vector<unsigned char> pixels;
+    bool dirty = false;
+    std::list<int64_t>::iterator recent;    // position in TiledImage::recentTiles
+};
+
+struct TiledImage {
+    std::string path;
+    int64_t width = 0;
+    int64_t height = 0;
+    int channels = 1;
+    int tileSize = TILED_IMAGE_TILE_SIZE;
+    int64_t tilesX = 0;
+    int64_t tilesY = 0;
+    size_t tileBytes = 0;
+    size_t cacheTiles = TILED_IMAGE_CACHE_TILES;
+
+    std::fstream file;
+    std::mutex fileMutex;                   // taken after cacheMutex, never before
+    std::mutex cacheMutex;
+    std::unordered_map<int64_t, TileCacheEntry> cache;
+    std::list<int64_t> recentTiles;         // most recently used first
+    uint64_t writeBacks = 0;                // a load that raced with a write-back is retried
+
+    std::thread prefetcher;
+    std::condition_variable prefetchWake;
+    std::deque<int64_t> prefetchQueue;
+    bool stopping = false;
+
+    // statistics
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t prefetched = 0;
+};
+
+// Helper function: read one tile from the file (zeros past the end of a fresh file)
+inline std::vector<unsigned char> readTileFromFile(TiledImage& image, int64_t index) {
+    std::vector<unsigned char> pixels(image.tileBytes, 0);
+    std::lock_guard<std::mutex> lock(image.fileMutex);
+    image.file.clear();
+    image.file.seekg(static_cast<std::streamoff>(index) * static_cast<std::streamoff>(image.tileBytes));
+    image.file.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+    image.file.clear();
+    return pixels;
+}
+
+// Helper function: write one tile back to the file
+inline void writeTileToFile(TiledImage& image, int64_t index, const std::vector<unsigned char>& pixels) {
+    std::lock_guard<std::mutex> lock(image.fileMutex);
+    image.file.clear();
+    image.file.seekp(static_cast<std::streamoff>(index) * static_cast<std::streamoff>(image.tileBytes));
+    image.file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+    if (!image.file.good()) {
+        std::cerr << "Error writing tile " << index << " of " << image.path << std::endl;
+    }
+}
+
+// Helper function: add a loaded tile to the cache, evicting the least recently used ones
+// (caller holds cacheMutex)
+inline TileCacheEntry& insertTile(TiledImage& image, int64_t index, std::vector<unsigned char>& pixels) {
+    while (image.cache.size() >= image.cacheTiles) {
+        int64_t victim = image.recentTiles.back();
+        image.recentTiles.pop_back();
+        auto found = image.cache.find(victim);
+        if (found->second.dirty) {
+            writeTileToFile(image, victim, found->second.pixels);
+            image.writeBacks++;
+        }
+        image.cache.erase(found);
+    }
+    image.recentTiles.push_front(index);
+    TileCacheEntry& entry = image.cache[index];
+    entry.pixels.swap(pixels);
+    entry.recent = image.recentTiles.begin();
+    return entry;
+}
+
+// Helper function: the cache entry of a tile, loaded on a miss. The lock is released while
+// the file is read; the entry is only valid until it is released again.
+inline TileCacheEntry& lockedTile(TiledImage& image, int64_t index, std::unique_lock<std::mutex>& lock) {
+    while (true) {
+        auto found = image.cache.find(index);
+        if (found != image.cache.end()) {
+            image.recentTiles.splice(image.recentTiles.begin(), image.recentTiles, found->second.recent);
+            image.hits++;
+            return found->second;
+        }
+        uint64_t generation = image.writeBacks;
+        lock.unlock();
+        std::vector<unsigned char> pixels = readTileFromFile(image, index);
+        lock.lock();
+        if (image.writeBacks == generation && image.cache.count(index) == 0) {
+            image.misses++;
+            return insertTile(image, index, pixels);
+        }
+    }
+}
+
+// Helper function: prefetch thread, loads announced tiles that are not cached yet
+inline void runTilePrefetcher(TiledImage* image) {
+    std::unique_lock<std::mutex> lock(image->cacheMutex);
+    while (true) {
+        image->prefetchWake.wait(lock, [image]() { return image->stopping || !image->prefetchQueue.empty(); });
+        if (image->stopping) {
+            return;
+        }
+        int64_t index = image->prefetchQueue.front();
+        image->prefetchQueue.pop_front();
+        if (image->cache.count(index) != 0) {
+            continue;
+        }
+        uint64_t generation = image->writeBacks;
+        lock.unlock();
+        std::vector<unsigned char> pixels = readTileFromFile(*image, index);
+        lock.lock();
+        if (image->writeBacks == generation && image->cache.count(index) == 0) {
+            insertTile(*image, index, pixels);
+            image->prefetched++;
+        }
+    }
+}
+
+// Function: open a tiled image file (create = true makes a new zero-filled one of this shape;
+// otherwise the shape must match the file). cacheTiles bounds the memory to about
+// cacheTiles * tileSize^2 * channels bytes.
+inline bool openTiledImage(TiledImage& image,
+                           const std::string& path,
+                           int64_t width,
+                           int64_t height,
+                           int channels,
+                           bool create,
+                           int tileSize = TILED_IMAGE_TILE_SIZE,
+                           size_t cacheTiles = TILED_IMAGE_CACHE_TILES) {
+    image.path = path;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.tileSize = tileSize;
+    image.tilesX = (width + tileSize - 1) / tileSize;
+    image.tilesY = (height + tileSize - 1) / tileSize;
+    image.tileBytes = static_cast<size_t>(tileSize) * tileSize * channels;
+    image.cacheTiles = std::max<size_t>(cacheTiles, 2);
+
+    const std::streamoff fileSize = static_cast<std::streamoff>(image.tilesX * image.tilesY) * static_cast<std::streamoff>(image.tileBytes);
+    if (create) {
+        // sized up front (sparse where the file system allows)
+        std::ofstream created(path, std::ios::binary | std::ios::trunc);
+        if (fileSize > 0) {
+            created.seekp(fileSize - 1);
+            created.put('\0');
+        }
+        if (!created.good()) {
+            std::cerr << "Cannot create the tiled image: " << path << std::endl;
+            return false;
+        }
+    }
+    image.file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!image.file.is_open()) {
+        std::cerr << "Cannot open the tiled image: " << path << std::endl;
+        return false;
+    }
+    image.file.seekg(0, std::ios::end);
+    if (image.file.tellg() < fileSize) {
+        std::cerr << "Tiled image " << path << " is smaller than its shape" << std::endl;
+        image.file.close();
+        return false;
+    }
+
+    image.stopping = false;
+    image.prefetcher = std::thread(runTilePrefetcher, &image);
+    return true;
+}
+
+// Function: write back every dirty tile
+inline void flushTiledImage(TiledImage& image) {
+    std::lock_guard<std::mutex> lock(image.cacheMutex);
+    for (auto& cached : image.cache) {
+        if (cached.second.dirty) {
+            writeTileToFile(image, cached.first, cached.second.pixels);
+            cached.second.dirty = false;
+        }
+    }
+    std::lock_guard<std::mutex> fileLock(image.fileMutex);
+    image.file.flush();
+}
+
+// Function: stop the prefetcher, flush and close
+inline void closeTiledImage(TiledImage& image) {
+    if (image.prefetcher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(image.cacheMutex);
+            image.stopping = true;
+        }
+        image.prefetchWake.notify_all();
+        image.prefetcher.join();
+    }
+    if (image.file.is_open()) {
+        flushTiledImage(image);
+        image.file.close();
+    }
+    image.cache.clear();
+    image.recentTiles.clear();
+    image.prefetchQueue.clear();
+}
+
+// Function: announce a region [x0, x1) x [y0, y1) (clipped to the image) that will be read
+// soon; its tiles are loaded in the background. At most half the cache is queued, so
+// prefetching never evicts the tiles in use.
+inline void prefetchTiledRegion(TiledImage& image, int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+    int64_t firstX = std::max<int64_t>(x0, 0) / image.tileSize;
+    int64_t firstY = std::max<int64_t>(y0, 0) / image.tileSize;
+    int64_t lastX = (std::min(x1, image.width) - 1) / image.tileSize;
+    int64_t lastY = (std::min(y1, image.height) - 1) / image.tileSize;
+    {
+        std::lock_guard<std::mutex> lock(image.cacheMutex);
+        for (int64_t ty = firstY; ty <= lastY; ++ty) {
+            for (int64_t tx = firstX; tx <= lastX; ++tx) {
+                int64_t index = ty * image.tilesX + tx;
+                if (image.cache.count(index) == 0 && image.prefetchQueue.size() < image.cacheTiles / 2) {
+                    image.prefetchQueue.push_back(index);
+                }
+            }
+        }
+    }
+    image.prefetchWake.notify_one();
+}
+
+// Function: copy a region into buffer (width x height x channels). The region must overlap
+// the image; pixels past its edges replicate the nearest edge pixel (halos of border blocks).
+inline void readTiledRegion(TiledImage& image, int64_t x0, int64_t y0, int width, int height, unsigned char* buffer) {
+    const int channels = image.channels;
+    const size_t rowBytes = static_cast<size_t>(width) * channels;
+    const int64_t copiedX0 = std::max<int64_t>(x0, 0);
+    const int64_t copiedX1 = std::min<int64_t>(x0 + width, image.width);
+    const int64_t copiedY0 = std::max<int64_t>(y0, 0);
+    const int64_t copiedY1 = std::min<int64_t>(y0 + height, image.height);
+
+    // the part inside the image, tile by tile
+    std::unique_lock<std::mutex> lock(image.cacheMutex);
+    for (int64_t ty = copiedY0 / image.tileSize; ty * image.tileSize < copiedY1; ++ty) {
+        for (int64_t tx = copiedX0 / image.tileSize; tx * image.tileSize < copiedX1; ++tx) {
+            const TileCacheEntry& tile = lockedTile(image, ty * image.tilesX + tx, lock);
+            int64_t rowBegin = std::max(copiedY0, ty * image.tileSize);
+            int64_t rowEnd = std::min(copiedY1, (ty + 1) * image.tileSize);
+            int64_t columnBegin = std::max(copiedX0, tx * image.tileSize);
+            int64_t columnEnd = std::min(copiedX1, (tx + 1) * image.tileSize);
+            for (int64_t y = rowBegin; y < rowEnd; ++y) {
+                const unsigned char* source = &tile.pixels[(static_cast<size_t>(y - ty * image.tileSize) * image.tileSize +
+                                                           static_cast<size_t>(columnBegin - tx * image.tileSize)) * channels];
+                unsigned char* target = buffer + static_cast<size_t>(y - y0) * rowBytes + static_cast<size_t>(columnBegin - x0) * channels;
+                std::memcpy(target, source, static_cast<size_t>(columnEnd - columnBegin) * channels);
+            }
+        }
+    }
+    lock.unlock();
+
+    // replicate the edges: columns first, then whole rows
+    for (int64_t y = copiedY0; y < copiedY1; ++y) {
+        unsigned char* row = buffer + static_cast<size_t>(y - y0) * rowBytes;
+        const unsigned char* left = row + static_cast<size_t>(copiedX0 - x0) * channels;
+        for (int64_t x = x0; x < copiedX0; ++x) {
+            std::memcpy(row + static_cast<size_t>(x - x0) * channels, left, channels);
+        }
+        const unsigned char* right = row + static_cast<size_t>(copiedX1 - 1 - x0) * channels;
+        for (int64_t x = copiedX1; x < x0 + width; ++x) {
+            std::memcpy(row + static_cast<size_t>(x - x0) * channels, right, channels);
+        }
+    }
+    for (int64_t y = y0; y < copiedY0; ++y) {
+        std::memcpy(buffer + static_cast<size_t>(y - y0) * rowBytes, buffer + static_cast<size_t>(copiedY0 - y0) * rowBytes, rowBytes);
+    }
+    for (int64_t y = copiedY1; y < y0 + height; ++y) {
+        std::memcpy(buffer + static_cast<size_t>(y - y0) * rowBytes, buffer + static_cast<size_t>(copiedY1 - 1 - y0) * rowBytes, rowBytes);
+    }
+}
+
+// Function: copy buffer (width x height x channels) into a region inside the image
+inline void writeTiledRegion(TiledImage& image, int64_t x0, int64_t y0, int width, int height, const unsigned char* buffer) {
+    const int channels = image.channels;
+    const size_t rowBytes = static_cast<size_t>(width) * channels;
+    std::unique_lock<std::mutex> lock(image.cacheMutex);
+    for (int64_t ty = y0 / image.tileSize; ty * image.tileSize < y0 + height; ++ty) {
+        for (int64_t tx = x0 / image.tileSize; tx * image.tileSize < x0 + width; ++tx) {
+            TileCacheEntry& tile = lockedTile(image, ty * image.tilesX + tx, lock);
+            int64_t rowBegin = std::max(y0, ty * image.tileSize);
+            int64_t rowEnd = std::min(y0 + height, (ty + 1) * image.tileSize);
+            int64_t columnBegin = std::max(x0, tx * image.tileSize);
+            int64_t columnEnd = std::min(x0 + width, (tx + 1) * image.tileSize);
+            for (int64_t y = rowBegin; y < rowEnd; ++y) {
+                unsigned char* target = &tile.pixels[(static_cast<size_t>(y - ty * image.tileSize) * image.tileSize +
+                                                     static_cast<size_t>(columnBegin - tx * image.tileSize)) * channels];
+                const unsigned char* source = buffer + static_cast<size_t>(y - y0) * rowBytes + static_cast<size_t>(columnBegin - x0) * channels;
+                std::memcpy(target, source, static_cast<size_t>(columnEnd - columnBegin) * channels);
+            }
+            tile.dirty = true;
+        }
+    }
+}
+
+// Function: stream a raw file (row-major, interleaved) into a tiled image, one band of tile
+// rows at a time
+inline bool importRawToTiled(const std::string& rawFile, TiledImage& image) {
+    std::ifstream input(rawFile, std::ios::binary);
+    if (!input) {
+        std::cerr << "Unable to open file: " << rawFile << std::endl;
+        return false;
+    }
+    const size_t rowBytes = static_cast<size_t>(image.width) * image.channels;
+    std::vector<unsigned char> band(rowBytes * image.tileSize);
+    std::vector<unsigned char> block(image.tileBytes);
+    for (int64_t y0 = 0; y0 < image.height; y0 += image.tileSize) {
+        int rows = static_cast<int>(std::min<int64_t>(image.tileSize, image.height - y0));
+        if (!input.read(reinterpret_cast<char*>(band.data()), rowBytes * rows)) {
+            std::cerr << "Raw file " << rawFile << " is shorter than the image" << std::endl;
+            return false;
+        }
+        // one tile at a time: gather its rows into a contiguous block
+        for (int64_t x0 = 0; x0 < image.width; x0 += image.tileSize) {
+            int columns = static_cast<int>(std::min<int64_t>(image.tileSize, image.width - x0));
+            for (int y = 0; y < rows; ++y) {
+                std::memcpy(&block[static_cast<size_t>(y) * columns * image.channels],
+                            &band[static_cast<size_t>(y) * rowBytes + static_cast<size_t>(x0) * image.channels],
+                            static_cast<size_t>(columns) * image.channels);
+            }
+            writeTiledRegion(image, x0, y0, columns, rows, block.data());
+        }
+    }
+    return true;
+}
+
+// Function: stream a tiled image out to a raw file (row-major, interleaved)
+inline bool exportTiledToRaw(TiledImage& image, const std::string& rawFile) {
+    std::ofstream output(rawFile, std::ios::binary);
+    if (!output) {
+        std::cerr << "Unable to open file for writing: " << rawFile << std::endl;
+        return false;
+    }
+    const size_t rowBytes = static_cast<size_t>(image.width) * image.channels;
+    std::vector<unsigned char> band(rowBytes * image.tileSize);
+    std::vector<unsigned char> block(image.tileBytes);
+    for (int64_t y0 = 0; y0 < image.height; y0 += image.tileSize) {
+        int rows = static_cast<int>(std::min<int64_t>(image.tileSize, image.height - y0));
+        prefetchTiledRegion(image, 0, y0 + image.tileSize, image.width, y0 + 2 * image.tileSize);
+        for (int64_t x0 = 0; x0 < image.width; x0 += image.tileSize) {
+            int columns = static_cast<int>(std::min<int64_t>(image.tileSize, image.width - x0));
+            readTiledRegion(image, x0, y0, columns, rows, block.data());
+            for (int y = 0; y < rows; ++y) {
+                std::memcpy(&band[static_cast<size_t>(y) * rowBytes + static_cast<size_t>(x0) * image.channels],
+                            &block[static_cast<size_t>(y) * columns * image.channels],
+                            static_cast<size_t>(columns) * image.channels);
+            }
+        }
+        output.write(reinterpret_cast<const char*>(band.data()), rowBytes * rows);
+    }
+    if (!output.good()) {
+        std::cerr << "Error occurred at writing time!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// One block of a tiled stencil: the output block at (x, y) of width x height pixels, with
+// the input around it (halo pixels on every side, image edges replicated)
+struct TiledBlock {
+    int64_t imageWidth;
+    int64_t imageHeight;
+    int64_t x;
+    int64_t y;
+    int width;
+    int height;
+    int halo;
+    int channels;
+    const unsigned char* input;             // (width + 2 halo) x (height + 2 halo) x channels
+    unsigned char* output;                  // width x height x channels, zero-initialized
+};
+
+typedef std::function<void(const TiledBlock& block)> TiledStencil;
+
+// Helper function: visit every storage tile in raster order as a block (output == nullptr
+// only reads). The next block and its halo are prefetched while the current one is computed.
+inline void forEachTiledBlock(TiledImage& input, TiledImage* output, int halo, const TiledStencil& stencil) {
+    const int tileSize = input.tileSize;
+    const int channels = input.channels;
+    std::vector<unsigned char> inputBlock(static_cast<size_t>(tileSize + 2 * halo) * (tileSize + 2 * halo) * channels);
+    std::vector<unsigned char> outputBlock(output ? input.tileBytes : 0);
+
+    for (int64_t ty = 0; ty < input.tilesY; ++ty) {
+        for (int64_t tx = 0; tx < input.tilesX; ++tx) {
+            int64_t nextX = (tx + 1 < input.tilesX) ? tx + 1 : 0;
+            int64_t nextY = (tx + 1 < input.tilesX) ? ty : ty + 1;
+            if (nextY < input.tilesY) {
+                prefetchTiledRegion(input, nextX * tileSize - halo, nextY * tileSize - halo,
+                                    (nextX + 1) * tileSize + halo, (nextY + 1) * tileSize + halo);
+            }
+
+            TiledBlock block;
+            block.imageWidth = input.width;
+            block.imageHeight = input.height;
+            block.x = tx * tileSize;
+            block.y = ty * tileSize;
+            block.width = static_cast<int>(std::min<int64_t>(tileSize, input.width - block.x));
+            block.height = static_cast<int>(std::min<int64_t>(tileSize, input.height - block.y));
+            block.halo = halo;
+            block.channels = channels;
+            readTiledRegion(input, block.x - halo, block.y - halo, block.width + 2 * halo, block.height + 2 * halo, inputBlock.data());
+            std::fill(outputBlock.begin(), outputBlock.end(), 0);
+            block.input = inputBlock.data();
+            block.output = output ? outputBlock.data() : nullptr;
+            stencil(block);
+            if (output) {
+                writeTiledRegion(*output, block.x, block.y, block.width, block.height, outputBlock.data());
+            }
+        }
+    }
+}
+
+// Function: run a neighborhood operator over the whole image, one storage tile at a time
+// (input and output must have the same shape and tile size; output pixels the operator does
+// not write are 0)
+inline void applyTiledStencil(TiledImage& input, TiledImage& output, int halo, const TiledStencil& stencil) {
+    forEachTiledBlock(input, &output, halo, stencil);
+}
+
+// Helper function: clip a 64-bit histogram (same redistribution as the in-memory CLAHE:
+// excess / bins to every bin, the remainder one each to the lowest bins)
+inline void clipTiledHistogram(std::vector<int64_t>& histogram, int64_t clipLimit) {
+    int64_t excess = 0;
+    for (auto& h : histogram) {
+        if (h > clipLimit) {
+            excess += h - clipLimit;
+            h = clipLimit;
+        }
+    }
+    int64_t increment = excess / static_cast<int64_t>(histogram.size());
+    int64_t residual = excess % static_cast<int64_t>(histogram.size());
+    for (auto& h : histogram) {
+        h += increment;
+        if (residual > 0) {
+            h++;
+            residual--;
+        }
+    }
+}
+
+// Function: CLAHE of a single-channel (gray or Y) tiled image with numTilesX x numTilesY contextual tiles
+// (tile size width / numTilesX, a short remainder tile where it does not divide; each pixel
+// takes the clipped, normalized CDF of its tile). Pass 1 streams the blocks to collect the
+// tile histograms, pass 2 streams them again to map the pixels.
+inline void tiledCLAHE(TiledImage& input, TiledImage& output, int numTilesX, int numTilesY, int64_t clipLimit) {
+    const int64_t tileSizeX = std::max<int64_t>(input.width / numTilesX, 1);
+    const int64_t tileSizeY = std::max<int64_t>(input.height / numTilesY, 1);
+    const int64_t claheTilesX = (input.width + tileSizeX - 1) / tileSizeX;
+    const int64_t claheTilesY = (input.height + tileSizeY - 1) / tileSizeY;
+    std::vector<std::vector<int64_t> > histograms(claheTilesX * claheTilesY, std::vector<int64_t>(256, 0));
+
+    forEachTiledBlock(input, nullptr, 0, [&](const TiledBlock& block) {
+        for (int y = 0; y < block.height; ++y) {
+            std::vector<int64_t>* tileRow = &histograms[((block.y + y) / tileSizeY) * claheTilesX];
+            const unsigned char* row = block.input + static_cast<size_t>(y) * block.width;
+            for (int x = 0; x < block.width; ++x) {
+                tileRow[(block.x + x) / tileSizeX][row[x]]++;
+            }
+        }
+    });
+
+    std::vector<std::vector<unsigned char> > mappings(histograms.size(), std::vector<unsigned char>(256));
+    for (size_t t = 0; t < histograms.size(); ++t) {
+        if (clipLimit > 0) {
+            clipTiledHistogram(histograms[t], clipLimit);
+        }
+        int64_t total = 0;
+        for (int64_t h : histograms[t]) {
+            total += h;
+        }
+        int64_t cdf = 0;
+        for (int i = 0; i < 256; ++i) {
+            cdf += histograms[t][i];
+            mappings[t][i] = static_cast<unsigned char>(total > 0 ? (cdf * 255) / total : i);
+        }
+    }
+
+    applyTiledStencil(input, output, 0, [&](const TiledBlock& block) {
+        for (int y = 0; y < block.height; ++y) {
+            const std::vector<unsigned char>* mappingRow = &mappings[((block.y + y) / tileSizeY) * claheTilesX];
+            const unsigned char* in = block.input + static_cast<size_t>(y) * block.width;
+            unsigned char* out = block.output + static_cast<size_t>(y) * block.width;
+            for (int x = 0; x < block.width; ++x) {
+                out[x] = mappingRow[(block.x + x) / tileSizeX][in[x]];
+            }
+        }
+    });
+}
+
+#endif // TILED_IMAGE_H
@@ -1,8 +1,53 @@
 import numpy as np
 import matplotlib.pyplot as plt
 import os
+import struct
+
+def read_container(file_path):
+    # Read a .craw container (see rawContainer.h); the shape comes from the header
+    with open(file_path, 'rb') as file:
+        data = file.read()
+    magic, version, _, width, height, channels, bit_depth, layout, _, _, band_height, num_bands = \
+        struct.unpack_from('<4sHHIIHHBBHII', data, 0)
+    if magic != b'CRAW' or version != 1 or bit_depth != 8:
+        raise ValueError("Unsupported container: " + file_path)
+
+    planes = channels if layout == 1 else 1
+    row_bytes = width if layout == 1 else width * channels
+    stride = 1 if layout == 1 else channels
+    image = np.empty((planes, height, row_bytes), dtype=np.uint8)
+
+    for band in range(num_bands):
+        offset, size, codec = struct.unpack_from('<QII', data, 32 + 24 * band)
+        rows = min(band_height, height - band * band_height)
+        chunk = data[offset:offset + size]
+        if codec == 1:
+            # byte RLE: control < 128 is a literal of control + 1 bytes, otherwise a run of control - 125
+            out = bytearray()
+            i = 0
+            while i < len(chunk):
+                control = chunk[i]
+                if control < 128:
+                    out += chunk[i + 1:i + 2 + control]
+                    i += control + 2
+                else:
+                    out += bytes([chunk[i + 1]]) * (control - 125)
+                    i += 2
+            # undo the horizontal delta with a running sum per channel, modulo 256
+            delta = np.frombuffer(bytes(out), dtype=np.uint8).reshape(planes, rows, row_bytes // stride, stride)
+            chunk = np.cumsum(delta, axis=2, dtype=np.uint8).tobytes()
+        start = band * band_height
+        image[:, start:start + rows, :] = np.frombuffer(chunk, dtype=np.uint8).reshape(planes, rows, row_bytes)
+
+    if layout == 1:
+        return np.squeeze(np.moveaxis(image, 0, -1))
+    return np.squeeze(image.reshape(height, width, channels))
 
 def read_raw_image(file_path, width, height, color_mode):
+    # Containers carry their own shape; headerless .raw files still need it from the caller
+    if file_path.endswith('.craw'):
+        return read_container(file_path)
+
     # Open the file
     with open(file_path, 'rb') as file:
         # Read the file and convert to numpy array
@@ -27,6 +72,8 @@ height = 512
 # For grayscale use tf_image_path, for RGB use bf_image_path as an example
 image_name = input("Enter the path to your raw image name: ")
 image_path = "./outputs/" + image_name + ".raw"
+if os.path.exists("./outputs/" + image_name + ".craw"):
+    image_path = "./outputs/" + image_name + ".craw"
 
 # Read and display the image
 image = read_raw_image(image_path, width, height, color_mode)